@@ -26,9 +26,12 @@
 #include <cstring>
 #include <cerrno>
 #include <numeric>
+#include <csignal>
 #include "parser.h"
 #include "message.h"
 #include "thinkfan.h"
+#include "config_cache.h"
+#include "hwmon.h"
 
 #ifdef USE_YAML
 #include "yamlconfig.h"
@@ -47,10 +50,17 @@ const unique_ptr<FanDriver> &FanConfig::fan() const
 void FanConfig::set_fan(unique_ptr<FanDriver> &&fan)
 { fan_ = std::move(fan); }
 
+unique_ptr<FanDriver> FanConfig::release_fan()
+{ return std::move(fan_); }
+
+bool FanConfig::wakeup_limits(vector<int> &, vector<int> &) const
+{ return false; }
+
 
 
 StepwiseMapping::StepwiseMapping(unique_ptr<FanDriver> &&fan_drv)
-: FanConfig(std::move(fan_drv))
+: FanConfig(std::move(fan_drv)),
+  compiled_(true)
 {}
 
 const vector<unique_ptr<Level>> &StepwiseMapping::levels() const
@@ -59,22 +69,17 @@ const vector<unique_ptr<Level>> &StepwiseMapping::levels() const
 void StepwiseMapping::init_fanspeed(const TemperatureState &ts)
 {
 	cur_lvl_ = --levels().end();
-	while (cur_lvl_ != levels().begin() && (*cur_lvl_)->down(ts))
-		cur_lvl_--;
+	step_down_(ts);
 	fan()->set_speed(**cur_lvl_);
 }
 
 bool StepwiseMapping::set_fanspeed(const TemperatureState &ts)
 {
-	if (unlikely(cur_lvl_ != --levels().end() && (*cur_lvl_)->up(ts))) {
-		while (cur_lvl_ != --levels().end() && (*cur_lvl_)->up(ts))
-			cur_lvl_++;
+	if (unlikely(step_up_(ts))) {
 		fan()->set_speed(**cur_lvl_);
 		return true;
 	}
-	else if (unlikely(cur_lvl_ != levels().begin() && (*cur_lvl_)->down(ts))) {
-		while (cur_lvl_ != levels().begin() && (*cur_lvl_)->down(ts))
-			cur_lvl_--;
+	else if (unlikely(step_down_(ts))) {
 		fan()->set_speed(**cur_lvl_);
 		tmp_sleeptime = sleeptime;
 		return true;
@@ -86,6 +91,73 @@ bool StepwiseMapping::set_fanspeed(const TemperatureState &ts)
 }
 
 
+bool StepwiseMapping::step_up_(const TemperatureState &ts)
+{
+	const auto top = --levels().end();
+
+	if (compiled_) {
+		// First level at or above the current one whose upper limit isn't reached, or the top level
+		auto first = thresholds_.begin() + (cur_lvl_ - levels().begin());
+		auto last = thresholds_.begin() + (top - levels().begin());
+		auto it = std::upper_bound(first, last, *ts.tmax, [] (int t, const Threshold &th) {
+			return t < th.upper;
+		});
+		cur_lvl_ += it - first;
+		return it != first;
+	}
+
+	const auto prev = cur_lvl_;
+	while (cur_lvl_ != top && (*cur_lvl_)->up(ts))
+		cur_lvl_++;
+	return cur_lvl_ != prev;
+}
+
+
+bool StepwiseMapping::step_down_(const TemperatureState &ts)
+{
+	if (compiled_) {
+		// Last level at or below the current one whose lower limit isn't undercut, or the bottom level
+		auto first = thresholds_.begin() + 1;
+		auto last = thresholds_.begin() + (cur_lvl_ - levels().begin()) + 1;
+		auto it = std::upper_bound(first, last, *ts.tmax, [] (int t, const Threshold &th) {
+			return t < th.lower;
+		});
+		cur_lvl_ -= last - it;
+		return it != last;
+	}
+
+	const auto prev = cur_lvl_;
+	while (cur_lvl_ != levels().begin() && (*cur_lvl_)->down(ts))
+		cur_lvl_--;
+	return cur_lvl_ != prev;
+}
+
+
+bool StepwiseMapping::wakeup_limits(vector<int> &lower, vector<int> &upper) const
+{
+	const Level &lvl = **cur_lvl_;
+	const bool top = cur_lvl_ == --levels().end();
+	const bool bottom = cur_lvl_ == levels().begin();
+
+	for (size_t i = 0; i < upper.size(); ++i) {
+		// A SimpleLevel has one limit that applies to all temperatures
+		size_t limit_idx = lvl.upper_limit().size() > 1 ? i : 0;
+		if (!top)
+			upper[i] = std::min(upper[i], lvl.upper_limit()[limit_idx]);
+		if (!bottom)
+			lower[i] = std::max(lower[i], lvl.lower_limit()[limit_idx]);
+	}
+	return true;
+}
+
+
+void StepwiseMapping::set_safe_speed()
+{
+	if (!levels().empty())
+		fan()->set_speed(*levels().back());
+}
+
+
 void StepwiseMapping::ensure_consistency(const Config &config) const
 {
 	if (levels().size() == 0)
@@ -128,6 +200,20 @@ void StepwiseMapping::add_level(unique_ptr<Level> &&level)
 		}
 	}
 
+	// The binary search in step_up_()/step_down_() only gives the same result as walking the levels
+	// one by one if all levels compare against tmax and the limits it searches are monotonic.
+	// The top level's upper and the bottom level's lower limit are never looked at.
+	if (!dynamic_cast<const SimpleLevel *>(level.get()))
+		compiled_ = false;
+	else {
+		thresholds_.push_back({ level->lower_limit().front(), level->upper_limit().front() });
+		size_t n = thresholds_.size();
+		if (n >= 3 && thresholds_[n-3].upper > thresholds_[n-2].upper)
+			compiled_ = false;
+		if (n >= 3 && thresholds_[n-2].lower > thresholds_[n-1].lower)
+			compiled_ = false;
+	}
+
 	levels_.push_back(std::move(level));
 }
 
@@ -135,9 +221,186 @@ void StepwiseMapping::add_level(unique_ptr<Level> &&level)
 
 
 
-const Config *Config::read_config(const vector<string> &filenames)
+CurveMapping::CurveMapping(unique_ptr<FanDriver> &&fan_drv, const vector<pair<int, int>> &points)
+: FanConfig(std::move(fan_drv)),
+  points_(points),
+  cur_idx_(0)
 {
-	const Config *rv = nullptr;
+	if (points_.empty())
+		throw ConfigError(MSG_CONF_CURVE_EMPTY);
+
+	for (auto it = points_.begin(); it != points_.end(); ++it) {
+		if (it->second < 0 || it->second > 255)
+			throw ConfigError(MSG_CONF_CURVE_PWM(it->second));
+		if (it != points_.begin() && std::prev(it)->first >= it->first)
+			throw ConfigError(MSG_CONF_CURVE_ORDER);
+	}
+
+	// Constant below the first and above the last point, linear in between (rounded to nearest)
+	auto p1 = points_.begin();
+	for (unsigned int t = 0; t < lut_.size(); ++t) {
+		while (p1 != points_.end() && p1->first < int(t))
+			++p1;
+
+		if (p1 == points_.begin())
+			lut_[t] = uint8_t(p1->second);
+		else if (p1 == points_.end())
+			lut_[t] = uint8_t(points_.back().second);
+		else {
+			auto p0 = std::prev(p1);
+			long num = long(int(t) - p0->first) * (p1->second - p0->second);
+			long den = p1->first - p0->first;
+			lut_[t] = uint8_t(p0->second + (2 * num + (num < 0 ? -den : den)) / (2 * den));
+		}
+	}
+}
+
+const vector<pair<int, int>> &CurveMapping::points() const
+{ return points_; }
+
+unsigned int CurveMapping::lut_index(int temp)
+{ return unsigned(std::min(std::max(temp, 0), 255)); }
+
+void CurveMapping::set_pwm_(uint8_t pwm)
+{ static_cast<HwmonFanDriver &>(*fan()).set_pwm(pwm); }
+
+
+void CurveMapping::init_fanspeed(const TemperatureState &ts)
+{
+	cur_idx_ = lut_index(*ts.tmax);
+	set_pwm_(lut_[cur_idx_]);
+}
+
+
+bool CurveMapping::set_fanspeed(const TemperatureState &ts)
+{
+	const unsigned int idx = lut_index(*ts.tmax);
+	const uint8_t pwm = lut_[idx];
+	const uint8_t cur_pwm = lut_[cur_idx_];
+	cur_idx_ = idx;
+
+	if (likely(pwm == cur_pwm))
+		return false;
+	if (pwm < cur_pwm)
+		tmp_sleeptime = sleeptime;
+	set_pwm_(pwm);
+	return true;
+}
+
+
+void CurveMapping::set_safe_speed()
+{
+	// ensure_consistency() hasn't checked the fan type yet
+	if (dynamic_cast<HwmonFanDriver *>(fan().get()))
+		set_pwm_(*std::max_element(lut_.begin(), lut_.end()));
+}
+
+
+bool CurveMapping::wakeup_limits(vector<int> &lower, vector<int> &upper) const
+{
+	// The range of temperatures around the current one that map to the same PWM value
+	unsigned int lo = cur_idx_, hi = cur_idx_;
+	while (lo > 0 && lut_[lo - 1] == lut_[cur_idx_])
+		--lo;
+	while (hi < lut_.size() - 1 && lut_[hi + 1] == lut_[cur_idx_])
+		++hi;
+
+	for (size_t i = 0; i < upper.size(); ++i) {
+		if (hi < lut_.size() - 1)
+			upper[i] = std::min(upper[i], int(hi) + 1);
+		if (lo > 0)
+			lower[i] = std::max(lower[i], int(lo));
+	}
+	return true;
+}
+
+
+void CurveMapping::ensure_consistency(const Config &) const
+{
+	if (!fan())
+		throw ConfigError("No fan specified in curve mapping.");
+
+	if (!dynamic_cast<const HwmonFanDriver *>(fan().get()))
+		throw ConfigError(MSG_CONF_CURVE_FAN);
+
+	int max_pwm = std::max_element(points_.begin(), points_.end(), [] (const pair<int, int> &l, const pair<int, int> &r) {
+		return l.second < r.second;
+	})->second;
+	if (max_pwm < 128)
+		error<ConfigError>(MSG_CONF_MAXLVL(max_pwm));
+}
+
+
+
+
+
+PidMapping::PidMapping(unique_ptr<FanDriver> &&fan_drv, const PidController &pid)
+: FanConfig(std::move(fan_drv)),
+  pid_(pid),
+  cur_pwm_(pid.out_min())
+{
+	if (pid_.out_min() < 0 || pid_.out_max() > 255 || pid_.out_min() >= pid_.out_max())
+		throw ConfigError(MSG_CONF_PID_RANGE(pid_.out_min(), pid_.out_max()));
+}
+
+void PidMapping::set_pwm_(int pwm)
+{
+	static_cast<HwmonFanDriver &>(*fan()).set_pwm(pwm);
+	cur_pwm_ = pwm;
+}
+
+
+void PidMapping::set_safe_speed()
+{
+	// ensure_consistency() hasn't checked the fan type yet
+	if (dynamic_cast<HwmonFanDriver *>(fan().get()))
+		set_pwm_(pid_.out_max());
+}
+
+
+void PidMapping::init_fanspeed(const TemperatureState &ts)
+{
+	pid_.reset(pid_.out_min());
+	last_step_ = std::chrono::steady_clock::now();
+	set_pwm_(pid_.step(*ts.tmax, 0));
+}
+
+
+bool PidMapping::set_fanspeed(const TemperatureState &ts)
+{
+	const auto now = std::chrono::steady_clock::now();
+	const auto dt = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_step_);
+	last_step_ = now;
+
+	const int pwm = pid_.step(*ts.tmax, unsigned(dt.count()));
+	if (likely(pwm == cur_pwm_))
+		return false;
+	if (pwm < cur_pwm_)
+		tmp_sleeptime = sleeptime;
+	set_pwm_(pwm);
+	return true;
+}
+
+
+void PidMapping::ensure_consistency(const Config &) const
+{
+	if (!fan())
+		throw ConfigError("No fan specified in PID mapping.");
+
+	if (!dynamic_cast<const HwmonFanDriver *>(fan().get()))
+		throw ConfigError(MSG_CONF_PID_FAN);
+
+	if (pid_.out_max() < 128)
+		error<ConfigError>(MSG_CONF_MAXLVL(pid_.out_max()));
+}
+
+
+
+
+
+Config *Config::read_config(const vector<string> &filenames)
+{
+	Config *rv = nullptr;
 	for (auto it = filenames.begin(); it != filenames.end(); ++it) {
 		try {
 			rv = try_read_config(*it);
@@ -152,7 +415,7 @@ const Config *Config::read_config(const vector<string> &filenames)
 }
 
 
-const Config *Config::try_read_config(const string &filename)
+Config *Config::try_read_config(const string &filename)
 {
 	Config *rv = nullptr;
 
@@ -169,6 +432,8 @@ const Config *Config::try_read_config(const string &filename)
 	if (!f_in.read(&*f_data.begin(), f_size))
 		throw IOerror(filename + ": ", errno);
 
+	ConfigCache::instance().load(filename, f_data);
+
 #ifdef USE_YAML
 	try	{
 		YAML::Node root = YAML::Load(f_data);
@@ -270,18 +535,87 @@ void Config::add_fan_config(unique_ptr<FanConfig> &&fan_cfg)
 { temp_mappings_.push_back(std::move(fan_cfg)); }
 
 
-void Config::init_fans() const
+void Config::init_drivers(bool force) const
 {
+	// Same order as always, since drivers that share an hwmon get their paths in the order they ask
+	vector<Driver *> pending;
+	unsigned int max_errors = 0;
+	for (const unique_ptr<SensorDriver> &sensor : sensors())
+		if (force || !sensor->initialized())
+			pending.push_back(sensor.get());
 	for (const unique_ptr<FanConfig> &fan_cfg : fan_configs())
-		try_init_driver(*fan_cfg->fan());
-}
+		if (force || !fan_cfg->fan()->initialized())
+			pending.push_back(fan_cfg->fan().get());
+	for (Driver *drv : pending)
+		max_errors = std::max(max_errors, drv->max_errors());
+
+	// Every driver gets its retries in the same rounds, so the longest of them is all we'll wait
+	const auto start = std::chrono::steady_clock::now();
+	const auto deadline = start + max_errors * sleeptime;
+	vector<bool> safe(fan_configs().size(), false);
+	int deferred_signal = 0;
+
+	auto sensors_pending = [&] () {
+		return std::any_of(pending.begin(), pending.end(), [] (Driver *drv) {
+			return dynamic_cast<SensorDriver *>(drv) != nullptr;
+		});
+	};
+
+	auto stop_waiting = [&] () {
+		if (deferred_signal)
+			interrupted = deferred_signal;
+		if (!pending.empty())
+			log(TF_WRN) << "Continuing without " << unsigned(pending.size()) << " of "
+				<< unsigned(sensors().size() + fan_configs().size()) << " devices, they're retried while running." << flush;
+	};
+
+	for (auto round_start = start; true; round_start += sleeptime) {
+		for (auto it = pending.begin(); it != pending.end();) {
+			(*it)->try_init();
+			// Optional drivers get only one chance, as before
+			if ((*it)->initialized() || (*it)->optional())
+				it = pending.erase(it);
+			else
+				++it;
+		}
+
+		// Every fan depends on all temperatures, but not on the other fans
+		if (!sensors_pending()) {
+			stop_waiting();
+			return;
+		}
 
+		// Fans that are ready must not stay at some arbitrary speed while we wait for the rest
+		for (size_t i = 0; i < fan_configs().size(); ++i) {
+			if (!safe[i] && fan_configs()[i]->fan()->initialized()) {
+				fan_configs()[i]->set_safe_speed();
+				safe[i] = true;
+			}
+		}
 
-TemperatureState Config::init_sensors() const
-{
-	for (const unique_ptr<SensorDriver> &sensor : sensors())
-		try_init_driver(*sensor);
-	return TemperatureState(num_temps());
+		// Each driver has had max_errors tries by now
+		if (round_start + sleeptime >= deadline) {
+			if (chk_sanity && !tolerate_errors)
+				throw SystemError("Gave up waiting for " + std::to_string(pending.size()) + " devices.");
+			stop_waiting();
+			return;
+		}
+
+		if (round_start == start) {
+			log(TF_INF) << "Waiting for " << unsigned(pending.size()) << " of "
+				<< unsigned(sensors().size() + fan_configs().size()) << " devices for up to "
+				<< std::to_string(std::chrono::duration_cast<std::chrono::seconds>(deadline - start).count())
+				<< " s. Fans that are ready run at their highest speed until then." << flush;
+		}
+
+		sleep_until(round_start + sleeptime);
+
+		if (interrupted == SIGINT || interrupted == SIGTERM)
+			throw SystemError("Interrupted while waiting for devices.");
+		else if (interrupted)
+			// Reloading or re-initializing has to wait until we're done here
+			deferred_signal = interrupted.exchange(0);
+	}
 }
 
 
@@ -295,25 +629,69 @@ void Config::init_temperature_refs(TemperatureState &tstate) const
 
 void Config::init(TemperatureState &ts) const
 {
-	ts = init_sensors();
-	init_fans();
+	// Devices may have come or gone since the last init
+	SysfsIndex::instance().clear();
+	// Also on resume and SIGUSR2, when fans may have lost their settings (e.g. pwm*_enable)
+	init_drivers(true);
+	ts = TemperatureState(num_temps());
 	ensure_consistency();
 	init_temperature_refs(ts);
+	save_cache();
 }
 
 
-void Config::try_init_driver(Driver &drv) const
+void Config::init(TemperatureState &ts, unique_ptr<Config> &&prev)
 {
-	while (true) {
-		drv.try_init();
-		if (drv.initialized() || drv.optional())
-			return;
-		else
-			sleep(sleeptime);
+	SysfsIndex::instance().clear();
+	bool same_sensors = sensors_.size() == prev->sensors_.size();
+	unsigned int kept_sensors = 0;
+	for (size_t i = 0; i < sensors_.size(); ++i) {
+		bool kept = false;
+		for (size_t j = 0; j < prev->sensors_.size() && !kept; ++j) {
+			if (prev->sensors_[j] && *prev->sensors_[j] == *sensors_[i]) {
+				sensors_[i] = std::move(prev->sensors_[j]);
+				same_sensors &= i == j;
+				kept = true;
+			}
+		}
+		same_sensors &= kept;
+		kept_sensors += kept;
+	}
+
+	unsigned int kept_fans = 0;
+	for (unique_ptr<FanConfig> &fan_cfg : temp_mappings_) {
+		for (unique_ptr<FanConfig> &prev_cfg : prev->temp_mappings_) {
+			if (prev_cfg->fan() && *prev_cfg->fan() == *fan_cfg->fan()) {
+				fan_cfg->set_fan(prev_cfg->release_fan());
+				++kept_fans;
+				break;
+			}
+		}
 	}
+
+	log(TF_DBG) << "Keeping " << kept_sensors << "/" << unsigned(sensors_.size()) << " sensors and "
+		<< kept_fans << "/" << unsigned(temp_mappings_.size()) << " fans." << flush;
+
+	// Drivers that are gone or changed must restore their hardware before a new driver takes it over
+	prev.reset();
+
+	init_drivers();
+	ensure_consistency();
+
+	if (!same_sensors) {
+		ts = TemperatureState(num_temps());
+		init_temperature_refs(ts);
+	}
+	save_cache();
 }
 
 
+void Config::save_cache() const
+{
+	ConfigCache::instance().report();
+	ConfigCache::instance().save();
+}
+
 
 Level::Level(int level, int lower_limit, int upper_limit)
 : Level(level, vector<int>(1, lower_limit), vector<int>(1, upper_limit))
@@ -398,38 +776,30 @@ void SimpleLevel::ensure_consistency(const Config &) const
 
 
 ComplexLevel::ComplexLevel(int level, const vector<int> &lower_limit, const vector<int> &upper_limit)
-: Level(level, lower_limit, upper_limit)
+: Level(level, lower_limit, upper_limit),
+  lower_simd_(lower_limit),
+  upper_simd_(upper_limit)
 {}
 
 
 ComplexLevel::ComplexLevel(string level, const vector<int> &lower_limit, const vector<int> &upper_limit)
-: Level(level, lower_limit, upper_limit)
+: Level(level, lower_limit, upper_limit),
+  lower_simd_(lower_limit),
+  upper_simd_(upper_limit)
 {}
 
 
 bool ComplexLevel::up(const TemperatureState &temp_state) const
 {
-	vector<int>::const_iterator temp_it = temp_state.biased_temps().begin();
-	auto upper_it = upper_limit().begin();
-
-	while (temp_it != temp_state.biased_temps().end())
-		if (*temp_it++ >= *upper_it++) return true;
-
-	return false;
+	const ArrayView<int> temps = temp_state.biased_temps();
+	return simd::any_ge(temps.data(), upper_simd_.data(), std::min(temps.size(), upper_simd_.size()));
 }
 
 
 bool ComplexLevel::down(const TemperatureState &temp_state) const
 {
-	auto temp_it = temp_state.biased_temps().begin();
-	auto lower_it = lower_limit().begin();
-
-	while (temp_it != temp_state.biased_temps().end() && *temp_it < *lower_it) {
-		temp_it++;
-		lower_it++;
-	}
-
-	return temp_it == temp_state.biased_temps().end();
+	const ArrayView<int> temps = temp_state.biased_temps();
+	return simd::all_lt(temps.data(), lower_simd_.data(), std::min(temps.size(), lower_simd_.size()));
 }
 
 
@@ -23,11 +23,14 @@
 #define THINKFAN_CONFIG_H_
 
 #include "temperature_state.h"
+#include "simd.h"
+#include "pid.h"
 
 #include <string>
 #include <vector>
 #include <memory>
 #include <map>
+#include <array>
 
 #include "thinkfan.h"
 
@@ -40,8 +43,19 @@ public:
 	virtual void init_fanspeed(const TemperatureState &) = 0;
 	virtual bool set_fanspeed(const TemperatureState &) = 0;
 	virtual void ensure_consistency(const Config &) const = 0;
+
+	/** @brief Run the fan at the highest speed this config would ever use. For when it's ready, but
+	 *  the temperatures it depends on aren't known yet. */
+	virtual void set_safe_speed() = 0;
+
+	/** @brief Narrow @a lower and @a upper (one entry per temperature) to the window in which the
+	 *  fan speed won't change. Limits are in the same unit as the biased temperatures.
+	 *  @return false if this config can't tell, i.e. it has to be evaluated periodically. */
+	virtual bool wakeup_limits(vector<int> &lower, vector<int> &upper) const;
+
 	void set_fan(unique_ptr<FanDriver> &&);
 	const unique_ptr<FanDriver> &fan() const;
+	unique_ptr<FanDriver> release_fan();
 
 private:
 	unique_ptr<FanDriver> fan_;
@@ -55,12 +69,72 @@ public:
 	virtual void init_fanspeed(const TemperatureState &) override;
 	virtual bool set_fanspeed(const TemperatureState &) override;
 	virtual void ensure_consistency(const Config &) const override;
+	virtual void set_safe_speed() override;
+	virtual bool wakeup_limits(vector<int> &lower, vector<int> &upper) const override;
 	void add_level(unique_ptr<Level> &&level);
 	const vector<unique_ptr<Level>> &levels() const;
 
 private:
+	/** @brief Flat copy of the limits of a mapping that consists only of SimpleLevels.
+	 *  Since both limits are then monotonic in the level index, the level that the
+	 *  up()/down() walk would end up on can be found with a binary search on tmax. */
+	struct Threshold {
+		int lower;
+		int upper;
+	};
+
+	/// @brief Move cur_lvl_ as far up/down as the temperatures require. @return true if it moved.
+	bool step_up_(const TemperatureState &);
+	bool step_down_(const TemperatureState &);
+
 	vector<unique_ptr<Level>> levels_;
 	vector<unique_ptr<Level>>::const_iterator cur_lvl_;
+	vector<Threshold> thresholds_;
+	bool compiled_;
+};
+
+
+/** @brief Maps the highest temperature to a PWM value by linear interpolation between
+ *  (temperature, pwm) points. The curve is sampled into a lookup table for 0..255°C when it's
+ *  loaded, so every tick costs a single array access. Only for hwmon fans. */
+class CurveMapping : public FanConfig {
+public:
+	CurveMapping(unique_ptr<FanDriver> &&fan_drv, const vector<pair<int, int>> &points);
+	virtual ~CurveMapping() override = default;
+	virtual void init_fanspeed(const TemperatureState &) override;
+	virtual bool set_fanspeed(const TemperatureState &) override;
+	virtual void ensure_consistency(const Config &) const override;
+	virtual void set_safe_speed() override;
+	virtual bool wakeup_limits(vector<int> &lower, vector<int> &upper) const override;
+	const vector<pair<int, int>> &points() const;
+
+private:
+	static unsigned int lut_index(int temp);
+	void set_pwm_(uint8_t pwm);
+
+	vector<pair<int, int>> points_;
+	std::array<uint8_t, 256> lut_;
+	unsigned int cur_idx_;
+};
+
+
+/** @brief Closed-loop control of a hwmon fan that holds the highest temperature at a target,
+ *  using a @a PidController. The fan is only written when the computed PWM value changes. */
+class PidMapping : public FanConfig {
+public:
+	PidMapping(unique_ptr<FanDriver> &&fan_drv, const PidController &pid);
+	virtual ~PidMapping() override = default;
+	virtual void init_fanspeed(const TemperatureState &) override;
+	virtual bool set_fanspeed(const TemperatureState &) override;
+	virtual void ensure_consistency(const Config &) const override;
+	virtual void set_safe_speed() override;
+
+private:
+	void set_pwm_(int pwm);
+
+	PidController pid_;
+	int cur_pwm_;
+	std::chrono::steady_clock::time_point last_step_;
 };
 
 
@@ -114,6 +188,10 @@ public:
 
 private:
 	static string format_limit(const vector<int> &limit);
+
+	// Aligned copies of lower_limit_ and upper_limit_ for the SIMD kernels
+	LimitArray lower_simd_;
+	LimitArray upper_simd_;
 };
 
 
@@ -122,23 +200,33 @@ public:
 	Config() = default;
 	~Config() = default;
 
-	static const Config *read_config(const vector<string> &filenames);
+	static Config *read_config(const vector<string> &filenames);
 	void add_sensor(unique_ptr<SensorDriver> &&sensor);
 	void add_fan_config(unique_ptr<FanConfig> &&fan_cfg);
 	void ensure_consistency() const;
-	void init_fans() const;
-	TemperatureState init_sensors() const;
+	/** @brief Initialize all drivers that aren't yet (or all of them if @a force is set), in rounds that
+	 *  try each of them once. Retries wait for the whole round, so a late device doesn't hold up the others.
+	 *  Returns as soon as all sensors are ready, or once every driver has had max_errors tries. Drivers that
+	 *  still aren't ready then are retried while running (or it throws if that's not tolerated). */
+	void init_drivers(bool force = false) const;
 	void init_temperature_refs(TemperatureState &tstate) const;
 	void init(TemperatureState &ts) const;
 
+	/** @brief Initialize this config to replace @a prev, which is destroyed in the process.
+	 *  Drivers that are unchanged are taken over from @a prev with all their state, so e.g. an
+	 *  unchanged fan is never reset to automatic control. If all sensors are unchanged, @a ts
+	 *  (including the temperature history) is kept as well. */
+	void init(TemperatureState &ts, unique_ptr<Config> &&prev);
+
 	unsigned int num_temps() const;
 	const vector<unique_ptr<SensorDriver>> &sensors() const;
 	const vector<unique_ptr<FanConfig>> &fan_configs() const;
 
 	string src_file;
 private:
-	static const Config *try_read_config(const string &data);
-	void try_init_driver(Driver &drv) const;
+	static Config *try_read_config(const string &data);
+	/// @brief Remember what the drivers' lookups found, for the next time this config is loaded.
+	void save_cache() const;
 	vector<unique_ptr<SensorDriver>> sensors_;
 	vector<unique_ptr<FanConfig>> temp_mappings_;
 };
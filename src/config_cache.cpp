@@ -0,0 +1,252 @@
+/********************************************************************
+ * config_cache.cpp: Persistent cache of expensive config lookups
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "config_cache.h"
+#include "message.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+
+namespace thinkfan {
+
+
+// Bump whenever the file format changes
+static const uint64_t format_version = 1;
+static const string magic = "thinkfan config cache";
+
+#if defined(CACHE_DIR)
+static const string cache_file = CACHE_DIR "/config.cache";
+#endif
+
+
+/// @brief FNV-1a, which is plenty to tell whether a config file has changed.
+static uint64_t content_hash(const string &data)
+{
+	uint64_t rv = 0xcbf29ce484222325ull;
+	for (char c : data) {
+		rv ^= static_cast<unsigned char>(c);
+		rv *= 0x100000001b3ull;
+	}
+	return rv;
+}
+
+
+// The cache is never shared between machines, so integers are simply stored in native byte order.
+static void put(string &out, uint64_t value)
+{ out.append(reinterpret_cast<const char *>(&value), sizeof(value)); }
+
+static void put(string &out, const string &value)
+{
+	put(out, uint64_t(value.size()));
+	out += value;
+}
+
+static bool get(const string &in, size_t &pos, uint64_t &value)
+{
+	if (in.size() - pos < sizeof(value))
+		return false;
+	std::memcpy(&value, in.data() + pos, sizeof(value));
+	pos += sizeof(value);
+	return true;
+}
+
+static bool get(const string &in, size_t &pos, string &value)
+{
+	uint64_t len;
+	if (!get(in, pos, len) || in.size() - pos < len)
+		return false;
+	value.assign(in, pos, len);
+	pos += len;
+	return true;
+}
+
+
+
+ConfigCache::ConfigCache()
+: mtime_ns_(0)
+, size_(0)
+, hash_(0)
+, dirty_(false)
+, hits_(0)
+, misses_(0)
+, lookup_time_(0)
+{}
+
+
+ConfigCache &ConfigCache::instance()
+{
+	static ConfigCache instance;
+	return instance;
+}
+
+
+void ConfigCache::load(const string &filename, const string &data)
+{
+	struct stat st;
+	int64_t mtime_ns = -1;
+	if (!::stat(filename.c_str(), &st))
+		mtime_ns = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+	uint64_t hash = content_hash(data);
+
+	if (filename == filename_ && mtime_ns == mtime_ns_ && data.size() == size_ && hash == hash_)
+		// Same config as before (e.g. on SIGHUP), so what we have in memory is still good
+		return;
+
+	filename_ = filename;
+	mtime_ns_ = mtime_ns;
+	size_ = data.size();
+	hash_ = hash;
+	lookups_.clear();
+	dirty_ = false;
+
+#if defined(CACHE_DIR)
+	std::ifstream f(cache_file, std::ios_base::binary);
+	if (!f.is_open())
+		return;
+	string cached((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	if (!parse_(cached)) {
+		lookups_.clear();
+		log(TF_DBG) << cache_file << " is outdated or doesn't belong to " << filename_ << "." << flush;
+	}
+#endif
+}
+
+
+bool ConfigCache::parse_(const string &data)
+{
+	size_t pos = 0;
+	string str;
+	uint64_t num;
+
+	if (!get(data, pos, str) || str != magic
+		|| !get(data, pos, num) || num != format_version
+		|| !get(data, pos, str) || str != VERSION
+		|| !get(data, pos, str) || str != filename_
+		|| !get(data, pos, num) || int64_t(num) != mtime_ns_
+		|| !get(data, pos, num) || num != size_
+		|| !get(data, pos, num) || num != hash_
+		|| !get(data, pos, num))
+		return false;
+
+	for (uint64_t count = num; count > 0; --count) {
+		string key;
+		Lookup lookup;
+		if (!get(data, pos, key) || !get(data, pos, lookup.resolved) || !get(data, pos, num))
+			return false;
+		lookup.paths.resize(num);
+		for (string &path : lookup.paths)
+			if (!get(data, pos, path))
+				return false;
+		lookups_.emplace(std::move(key), std::move(lookup));
+	}
+
+	return pos == data.size();
+}
+
+
+string ConfigCache::serialize_() const
+{
+	string rv;
+	put(rv, magic);
+	put(rv, format_version);
+	put(rv, VERSION);
+	put(rv, filename_);
+	put(rv, uint64_t(mtime_ns_));
+	put(rv, size_);
+	put(rv, hash_);
+	put(rv, uint64_t(lookups_.size()));
+	for (const auto &entry : lookups_) {
+		put(rv, entry.first);
+		put(rv, entry.second.resolved);
+		put(rv, uint64_t(entry.second.paths.size()));
+		for (const string &path : entry.second.paths)
+			put(rv, path);
+	}
+	return rv;
+}
+
+
+const ConfigCache::Lookup *ConfigCache::find(const string &key, std::function<bool (const Lookup &)> valid)
+{
+	auto it = lookups_.find(key);
+	if (it == lookups_.end() || !valid(it->second))
+		return nullptr;
+	++hits_;
+	return &it->second;
+}
+
+
+void ConfigCache::store(const string &key, const Lookup &lookup)
+{
+	++misses_;
+	lookups_[key] = lookup;
+	dirty_ = true;
+}
+
+
+void ConfigCache::save()
+{
+	if (!dirty_)
+		return;
+	dirty_ = false;
+
+#if defined(CACHE_DIR)
+	if (::mkdir(CACHE_DIR, 0755) && errno != EEXIST) {
+		log(TF_DBG) << "Can't create " CACHE_DIR ": " << strerror(errno) << flush;
+		return;
+	}
+
+	// Write to a temporary file first, so a concurrent start never sees half a cache
+	const string tmp_file = cache_file + ".tmp";
+	string data = serialize_();
+	std::ofstream f(tmp_file, std::ios_base::binary | std::ios_base::trunc);
+	if (!(f.is_open() && f.write(data.data(), std::streamsize(data.size())) && f.flush())) {
+		log(TF_DBG) << "Can't write " << tmp_file << ": " << strerror(errno) << flush;
+		return;
+	}
+	f.close();
+	if (::rename(tmp_file.c_str(), cache_file.c_str()))
+		log(TF_DBG) << "Can't write " << cache_file << ": " << strerror(errno) << flush;
+#endif
+}
+
+
+void ConfigCache::add_lookup_time(std::chrono::steady_clock::duration duration)
+{ lookup_time_ += duration; }
+
+
+void ConfigCache::report()
+{
+	if (!hits_ && !misses_)
+		return;
+
+	log(TF_DBG) << "Looked up " << hits_ + misses_ << " hwmons (" << hits_ << " from cache) in "
+		<< std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(lookup_time_).count())
+		<< " us." << flush;
+	hits_ = misses_ = 0;
+	lookup_time_ = std::chrono::steady_clock::duration(0);
+}
+
+
+} // namespace thinkfan
@@ -0,0 +1,83 @@
+#pragma once
+
+/********************************************************************
+ * config_cache.h: Persistent cache of expensive config lookups
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "thinkfan.h"
+
+#include <functional>
+#include <map>
+
+namespace thinkfan {
+
+
+/** @brief Remembers what the hwmon lookups of a config resolved to, so they don't have to search
+ *  sysfs again on the next start. It's stored in a compact binary file in CACHE_DIR (which should be
+ *  on a tmpfs, so it doesn't survive a reboot) and it's only valid for the exact config file it was
+ *  made from, as identified by its mtime, size and a hash of its content.
+ *  Cached results must still be checked by whoever uses them, since drivers may have been reloaded. */
+class ConfigCache {
+public:
+	struct Lookup {
+		/// The hwmon directory that was found by name or model (or just the base path)
+		string resolved;
+		/// The files that were found in it
+		vector<string> paths;
+	};
+
+	static ConfigCache &instance();
+
+	/** @brief Switch to the config file @a filename that has the content @a data. Loads the cache file
+	 *  if it belongs to this config, and starts out empty otherwise. */
+	void load(const string &filename, const string &data);
+
+	/// @return The cached lookup for @a key if there is one and @a valid confirms it, else nullptr.
+	const Lookup *find(const string &key, std::function<bool (const Lookup &)> valid);
+	void store(const string &key, const Lookup &lookup);
+
+	/// @brief Write the cache file if anything has been stored since it was loaded. Errors are only logged.
+	void save();
+
+	/// @brief Account for the time it took to do one lookup, with or without the cache.
+	void add_lookup_time(std::chrono::steady_clock::duration duration);
+
+	/// @brief Log how many lookups came from the cache and how long all of them took, then start over.
+	void report();
+
+private:
+	ConfigCache();
+
+	bool parse_(const string &data);
+	string serialize_() const;
+
+	string filename_;
+	int64_t mtime_ns_;
+	uint64_t size_;
+	uint64_t hash_;
+	std::map<string, Lookup> lookups_;
+	bool dirty_;
+	unsigned int hits_;
+	unsigned int misses_;
+	std::chrono::steady_clock::duration lookup_time_;
+};
+
+
+} // namespace thinkfan
@@ -22,13 +22,22 @@
 #include "driver.h"
 #include "message.h"
 
+#include <typeinfo>
+
 namespace thinkfan {
 
+
+// Backoff between attempts to init a driver whose device is missing
+static const milliseconds min_retry_delay(5000);
+static const milliseconds max_retry_delay(300000);
+
+
 Driver::Driver(bool optional, unsigned int max_errors)
 : max_errors_(max_errors)
 , errors_(0)
 , optional_(optional)
 , initialized_(false)
+, retry_delay_(0)
 {}
 
 
@@ -48,6 +57,20 @@ void Driver::try_init()
 			log() << "while initializing " << type_name() << ": " << e.what() << flush;
 		}
 	);
+
+	if (initialized() && available())
+		reset_backoff();
+	else if (backs_off()) {
+		retry_delay_ = std::min(max_retry_delay, std::max(min_retry_delay, 2 * retry_delay_));
+		retry_after_ = std::chrono::steady_clock::now() + retry_delay_;
+	}
+}
+
+
+void Driver::reset_backoff()
+{
+	retry_delay_ = milliseconds(0);
+	retry_after_ = std::chrono::steady_clock::time_point();
 }
 
 
@@ -79,6 +102,10 @@ void Driver::handle_io_error_(const ExpectedError &e, FN<void (const ExpectedErr
 }
 
 
+bool Driver::backs_off() const
+{ return false; }
+
+
 unsigned int Driver::errors() const
 { return errors_; }
 
@@ -97,6 +124,14 @@ bool Driver::initialized() const
 bool Driver::available() const
 { return path_.has_value(); }
 
+bool Driver::operator == (const Driver &other) const
+{
+	return typeid(*this) == typeid(other)
+		&& optional_ == other.optional_
+		&& max_errors_ == other.max_errors_
+		&& source() == other.source();
+}
+
 void Driver::skip_io_error(const ExpectedError &e)
 { log(TF_ERR) << e.what() << flush; }
 
@@ -54,12 +54,25 @@ public:
 	bool initialized() const;
 	bool available() const;
 
+	/** @brief Forget that the last attempt to init failed, so the next @a robust_io() tries again right
+	 *  away instead of waiting for the backoff (e.g. because some device has just been added). */
+	void reset_backoff();
+
+	/** @brief Equal drivers are configured identically, i.e. they would drive the same resource in the
+	 *  same way. Unlike @a path(), this works before lookup(). */
+	bool operator == (const Driver &other) const;
+
 private:
 	unsigned int max_errors_;
 	unsigned int errors_;
 	bool optional_;
 	bool initialized_;
 
+	// While init keeps failing at runtime, the device is assumed to be missing and only looked for
+	// again with exponentially increasing delays (cf. backs_off()).
+	milliseconds retry_delay_;
+	std::chrono::steady_clock::time_point retry_after_;
+
 	void handle_io_error_(const ExpectedError &e, FN<void (const ExpectedError &)> skip_fn);
 
 protected:
@@ -75,8 +88,16 @@ protected:
 	/// @return A user-friendly name for the type of driver represented by the implementor
 	virtual string type_name() const = 0;
 
+	/** @return The resource as it's given in the config (e.g. a hwmon base path with name and indices),
+	 *  plus any driver-specific options. */
+	virtual string source() const = 0;
+
 	virtual void skip_io_error(const ExpectedError &);
 
+	/** @return Whether failed attempts to init at runtime should be retried with a backoff instead of
+	 *  on every use, i.e. whether the device may just stay missing without counting as an error. */
+	virtual bool backs_off() const;
+
 	opt<const string> path_;
 };
 
@@ -86,8 +107,11 @@ void Driver::robust_io(void (DriverT::*io_func)(ArgTs...), ArgTs &&... args)
 {
 	using namespace std::placeholders;
 
-	if (!available() || !initialized())
+	if (!available() || !initialized()) {
+		if (std::chrono::steady_clock::now() < retry_after_)
+			return;
 		try_init();
+	}
 
 	if (initialized())
 		robust_op(
@@ -0,0 +1,217 @@
+/********************************************************************
+ * event_loop.cpp: epoll-based waiting for deadlines, signals and fds
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "event_loop.h"
+#include "error.h"
+#include "message.h"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+namespace thinkfan {
+
+
+static sigset_t handled_signals()
+{
+	sigset_t rv;
+	sigemptyset(&rv);
+	for (int signum : { SIGHUP, SIGINT, SIGTERM, SIGUSR1, SIGUSR2, SIGPWR })
+		sigaddset(&rv, signum);
+	return rv;
+}
+
+
+static SystemError errno_error(const string &what)
+{
+	string msg = strerror(errno);
+	return SystemError(what + ": " + msg);
+}
+
+
+void EventLoop::block_signals()
+{
+	sigset_t signals = handled_signals();
+	if (int err = pthread_sigmask(SIG_BLOCK, &signals, nullptr))
+		throw SystemError(string("pthread_sigmask(): ") + strerror(err));
+}
+
+
+EventLoop::EventLoop(std::function<void(int)> signal_handler)
+: epoll_fd_(-1)
+, timer_fd_(-1)
+, signal_fd_(-1)
+, signal_handler_(signal_handler)
+{
+	try {
+		if ((epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC)) < 0)
+			throw errno_error("epoll_create1()");
+
+		// std::chrono::steady_clock is CLOCK_MONOTONIC, so we can use its time points as they are.
+		if ((timer_fd_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+			throw errno_error("timerfd_create()");
+		add_(timer_fd_, EPOLLIN);
+
+		sigset_t signals = handled_signals();
+		if ((signal_fd_ = ::signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+			throw errno_error("signalfd()");
+		add_(signal_fd_, EPOLLIN);
+	} catch (...) {
+		for (int fd : { signal_fd_, timer_fd_, epoll_fd_ })
+			if (fd >= 0)
+				::close(fd);
+		throw;
+	}
+}
+
+
+EventLoop::~EventLoop()
+{
+	for (int fd : { signal_fd_, timer_fd_, epoll_fd_ })
+		::close(fd);
+}
+
+
+void EventLoop::add_(int fd, uint32_t events)
+{
+	struct epoll_event ev;
+	std::memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev))
+		throw errno_error("epoll_ctl()");
+}
+
+
+bool EventLoop::set_sources(const vector<pollfd> &sources)
+{
+	bool rv = true;
+
+	for (int fd : sources_) {
+		bool keep = false;
+		for (const pollfd &src : sources)
+			keep |= src.fd == fd;
+		if (!keep)
+			// May fail because the fd has already been closed, which removes it from the set anyways
+			::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+	}
+
+	sources_.clear();
+	for (const pollfd &src : sources) {
+		struct epoll_event ev;
+		std::memset(&ev, 0, sizeof(ev));
+		ev.events = (src.events & POLLIN ? EPOLLIN : 0u) | (src.events & POLLPRI ? EPOLLPRI : 0u);
+		ev.data.fd = src.fd;
+		// A sensor may have closed and reopened its file under the same fd number, which silently
+		// removed it from the set. So don't rely on what we registered before.
+		if (::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, src.fd, &ev)) {
+			if (errno == ENOENT && ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, src.fd, &ev) == 0)
+				sources_.push_back(src.fd);
+			else if (errno == EPERM) {
+				log(TF_DBG) << "Can't wait for events on fd " << std::to_string(src.fd) << "." << flush;
+				rv = false;
+			}
+			else
+				throw errno_error("epoll_ctl()");
+		}
+		else
+			sources_.push_back(src.fd);
+	}
+
+	return rv;
+}
+
+
+void EventLoop::add_watch(int fd)
+{ add_(fd, EPOLLIN); }
+
+
+void EventLoop::arm_timer_(clock::time_point until)
+{
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(until.time_since_epoch()).count();
+	struct itimerspec spec;
+	std::memset(&spec, 0, sizeof(spec));
+	// An all-zero it_value would disarm the timer
+	ns = std::max<decltype(ns)>(ns, 1);
+	spec.it_value.tv_sec = time_t(ns / 1000000000);
+	spec.it_value.tv_nsec = long(ns % 1000000000);
+	if (::timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr))
+		throw errno_error("timerfd_settime()");
+	armed_ = until;
+}
+
+
+void EventLoop::handle_signals_()
+{
+	struct signalfd_siginfo info;
+	while (::read(signal_fd_, &info, sizeof(info)) == ssize_t(sizeof(info)))
+		signal_handler_(int(info.ssi_signo));
+}
+
+
+bool EventLoop::wait_until(clock::time_point until, vector<int> &ready)
+{
+	struct epoll_event events[16];
+	ready.clear();
+
+	while (!interrupted) {
+		// Only reprogram the timer when the deadline actually changed
+		if (!armed_ || *armed_ != until)
+			arm_timer_(until);
+
+		int n = ::epoll_wait(epoll_fd_, events, sizeof(events) / sizeof(*events), -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			throw errno_error("epoll_wait()");
+		}
+
+		bool expired = false;
+		for (int i = 0; i < n; ++i) {
+			int fd = events[i].data.fd;
+			if (fd == timer_fd_) {
+				uint64_t expirations;
+				if (::read(timer_fd_, &expirations, sizeof(expirations)) > 0) {
+					armed_ = nullopt;
+					expired = true;
+				}
+			}
+			else if (fd == signal_fd_)
+				handle_signals_();
+			else
+				ready.push_back(fd);
+		}
+
+		if (!ready.empty())
+			return true;
+		if (expired)
+			return false;
+	}
+
+	return true;
+}
+
+
+} // namespace thinkfan
@@ -0,0 +1,78 @@
+#pragma once
+
+/********************************************************************
+ * event_loop.h: epoll-based waiting for deadlines, signals and fds
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "thinkfan.h"
+
+#include <csignal>
+#include <poll.h>
+
+namespace thinkfan {
+
+
+/** @brief One epoll set that holds a timerfd for the next deadline, a signalfd for the signals
+ *  we handle, and any number of additional fds (e.g. sensor alarms).
+ *  Since signals are received synchronously, their handler runs in the normal program context and
+ *  may do anything. */
+class EventLoop {
+public:
+	using clock = std::chrono::steady_clock;
+
+	/** @brief Block the signals that are handled through the signalfd. Must be called before any
+	 *  threads are started, so they all inherit the signal mask. */
+	static void block_signals();
+
+	/// @param signal_handler Called from wait_until() for each signal that's received.
+	EventLoop(std::function<void(int)> signal_handler);
+	EventLoop(const EventLoop &) = delete;
+	~EventLoop();
+
+	/** @brief Watch exactly the fds in @a sources from now on (POLLIN and POLLPRI are supported).
+	 *  Cheap to call repeatedly with the same set.
+	 *  @return false if some of them can't be watched (e.g. regular files), so they need to be polled. */
+	bool set_sources(const vector<pollfd> &sources);
+
+	/** @brief Watch @a fd for POLLIN independently of the sources, until it's closed.
+	 *  It's reported by wait_until() just like a source. */
+	void add_watch(int fd);
+
+	/** @brief Sleep until @a until (with nanosecond precision), until a signal sets @a interrupted,
+	 *  or until one of the sources becomes ready.
+	 *  @param ready Receives the sources that are ready (cleared first).
+	 *  @return false if @a until was reached. */
+	bool wait_until(clock::time_point until, vector<int> &ready);
+
+private:
+	void add_(int fd, uint32_t events);
+	void arm_timer_(clock::time_point until);
+	void handle_signals_();
+
+	int epoll_fd_;
+	int timer_fd_;
+	int signal_fd_;
+	std::function<void(int)> signal_handler_;
+	vector<int> sources_;
+	opt<clock::time_point> armed_;
+};
+
+
+} // namespace thinkfan
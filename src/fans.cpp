@@ -24,9 +24,9 @@
 #include "message.h"
 #include "config.h"
 
+#include <algorithm>
 #include <fstream>
 #include <cstring>
-#include <thread>
 #include <typeinfo>
 
 #ifdef USE_NVML
@@ -35,6 +35,10 @@
 
 namespace thinkfan {
 
+// Consecutive feedback samples with 0 RPM before a fan that should be turning is considered stalled.
+// Just one might be a fan that is still spinning up.
+static const unsigned int stall_samples = 2;
+
 /*----------------------------------------------------------------------------
 | FanDriver: Superclass of TpFanDriver and HwmonFanDriver. Can set the speed |
 | on its own since an implementation-specific string representation is       |
@@ -45,14 +49,31 @@ FanDriver::FanDriver(bool optional, unsigned int watchdog_timeout, opt<unsigned
 : Driver(optional, max_errors.value_or(0)),
   current_speed_("_"),
   watchdog_(watchdog_timeout),
-  depulse_(0)
+  depulse_(0),
+  out_(O_WRONLY),
+  speed_known_(false),
+  suppressed_writes_(0),
+  stalled_samples_(0)
 {}
 
 FanDriver::~FanDriver() noexcept(false)
-{}
+{
+	if (suppressed_writes_)
+		log(TF_DBG) << path() << ": Suppressed " << std::to_string(suppressed_writes_)
+			<< " redundant writes." << flush;
+}
 
 void FanDriver::set_speed(const string &level)
-{ robust_io(&FanDriver::set_speed_, level); }
+{
+	if (speed_known_ && level == current_speed_) {
+		if (!watchdog_due_()) {
+			++suppressed_writes_;
+			return;
+		}
+		log(TF_DBG) << "Watchdog ping" << flush;
+	}
+	robust_io(&FanDriver::set_speed_, level);
+}
 
 void FanDriver::skip_io_error(const ExpectedError &)
 {}
@@ -60,22 +81,53 @@ void FanDriver::skip_io_error(const ExpectedError &)
 
 void FanDriver::set_speed_(const string &level)
 {
-	std::ofstream f_out(path());
-	if(!(f_out << level << std::flush)) {
-		int err = errno;
-		if (err == EPERM)
+	try {
+		if (!out_.is_open())
+			out_.open(path());
+		out_.write(level.data(), level.length());
+	} catch (IOerror &e) {
+		if (e.code() == EPERM)
 			throw SystemError(MSG_FAN_EPERM(path()));
 		else
-			throw IOerror(MSG_FAN_CTRL(level, path()), err);
+			throw IOerror(MSG_FAN_CTRL(level, path()), e.code());
 	}
 	current_speed_ = level;
+	speed_known_ = true;
+	last_watchdog_ping_ = std::chrono::steady_clock::now();
 }
 
 
+bool FanDriver::watchdog_due_() const
+{
+	// Ping once half the watchdog timeout has passed. The main loop never sleeps past that point,
+	// no matter how long the sleeptime currently is (cf. hwmon alarms and idle backoff).
+	opt<std::chrono::steady_clock::time_point> deadline = watchdog_deadline();
+	return deadline && *deadline <= std::chrono::steady_clock::now();
+}
+
+
+opt<std::chrono::steady_clock::time_point> FanDriver::watchdog_deadline() const
+{
+	if (watchdog_ == seconds(0) || !speed_known_)
+		return nullopt;
+	return last_watchdog_ping_ + watchdog_ / 2;
+}
+
+
+void FanDriver::reset_output()
+{
+	out_.close();
+	speed_known_ = false;
+}
+
+
+unsigned long FanDriver::suppressed_writes() const
+{ return suppressed_writes_; }
+
+
 bool FanDriver::operator == (const FanDriver &other) const
 {
-	return typeid(*this) == typeid(other)
-			&& this->path() == other.path()
+	return Driver::operator == (other)
 			&& this->depulse_ == other.depulse_
 			&& this->watchdog_ == other.watchdog_;
 }
@@ -84,6 +136,62 @@ const string &FanDriver::current_speed() const
 { return current_speed_; }
 
 
+void FanDriver::sample_feedback()
+{
+	if (!initialized() || !speed_known_)
+		return;
+
+	Feedback feedback;
+	try {
+		feedback = read_feedback();
+	} catch (ExpectedError &e) {
+		log(TF_DBG) << path() << ": Can't read fan feedback: " << e.what() << flush;
+		return;
+	}
+	rpm_ = feedback.rpm;
+
+	if (!feedback.confirmed) {
+		log(TF_WRN) << MSG_FAN_OVERRIDDEN(path(), current_speed_) << flush;
+		const string level = current_speed_;
+		try {
+			init();
+			set_speed(level);
+		} catch (ExpectedError &e) {
+			log(TF_ERR) << e.what() << flush;
+		}
+		stalled_samples_ = 0;
+		return;
+	}
+
+	if (rpm_ && *rpm_ == 0 && should_spin()) {
+		if (++stalled_samples_ == stall_samples)
+			log(TF_WRN) << MSG_FAN_STALLED(path(), current_speed_) << flush;
+	}
+	else {
+		if (rpm_ && stalled_samples_ >= stall_samples)
+			log(TF_NFY) << MSG_FAN_UNSTALLED(path(), *rpm_) << flush;
+		stalled_samples_ = 0;
+	}
+}
+
+
+opt<unsigned int> FanDriver::rpm() const
+{ return rpm_; }
+
+FanDriver::Feedback FanDriver::read_feedback()
+{ return { nullopt, true }; }
+
+bool FanDriver::should_spin() const
+{ return true; }
+
+
+opt<std::chrono::steady_clock::time_point> FanDriver::depulse_deadline() const
+{ return nullopt; }
+
+void FanDriver::end_depulse(std::chrono::steady_clock::time_point)
+{}
+
+
 /*----------------------------------------------------------------------------
 | TpFanDriver: Driver for fan control via thinkpad_acpi, typically in        |
 | /proc/acpi/ibm/fan. Supports fan watchdog and depulsing (an alleged remedy |
@@ -93,7 +201,7 @@ const string &FanDriver::current_speed() const
 TpFanDriver::TpFanDriver(const std::string &path, bool optional, opt<unsigned int> max_errors)
 : FanDriver(optional, 120, max_errors)
 , path_(path)
-{}
+{ set_depulse(depulse); }
 
 
 TpFanDriver::~TpFanDriver() noexcept(false)
@@ -125,27 +233,53 @@ void TpFanDriver::set_depulse(float duration)
 
 void TpFanDriver::set_speed(const Level &level)
 {
+	// A level change ends a depulse right away
+	reengage_at_ = nullopt;
 	FanDriver::set_speed(level.str());
-	last_watchdog_ping_ = std::chrono::system_clock::now();
 }
 
 
 void TpFanDriver::ping_watchdog_and_depulse(const Level &level)
 {
 	if (depulse_ > std::chrono::milliseconds(0)) {
-		FanDriver::set_speed("level disengaged");
-		std::this_thread::sleep_for(depulse_);
-		set_speed(level);
+		// Don't block the main loop while the fan is disengaged. Instead, it calls end_depulse()
+		// once the deadline has passed, and keeps sampling temperatures in the meantime.
+		auto now = std::chrono::steady_clock::now();
+		reengage_level_ = level.str();
+		if (reengage_at_)
+			return;
+		if (now >= next_depulse_) {
+			FanDriver::set_speed("level disengaged");
+			reengage_at_ = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(depulse_);
+			return;
+		}
 	}
-	else if (last_watchdog_ping_ + watchdog_ - sleeptime <= std::chrono::system_clock::now()) {
-		log(TF_DBG) << "Watchdog ping" << flush;
-		set_speed(level);
+	// Only actually written if the level changed or the watchdog needs a ping
+	set_speed(level);
+}
+
+
+opt<std::chrono::steady_clock::time_point> TpFanDriver::depulse_deadline() const
+{ return reengage_at_; }
+
+
+void TpFanDriver::end_depulse(std::chrono::steady_clock::time_point now)
+{
+	if (reengage_at_ && *reengage_at_ <= now) {
+		reengage_at_ = nullopt;
+		// The main loop restarts the control tick at @a now, so don't disengage again before that,
+		// even if some sensor wakes us up earlier.
+		next_depulse_ = now + sleeptime;
+		FanDriver::set_speed(reengage_level_);
 	}
 }
 
 
 void TpFanDriver::init()
 {
+	reset_output();
+	reengage_at_ = nullopt;
+	next_depulse_ = std::chrono::steady_clock::time_point::min();
 	bool ctrl_supported = false;
 	std::fstream f(path());
 	if (!(f.is_open() && f.good()))
@@ -180,6 +314,8 @@ void TpFanDriver::init()
 
 	if (!(f << "watchdog " << watchdog_.count() << std::flush))
 		throw IOerror(MSG_FAN_INIT(path()), errno);
+
+	state_.open(path());
 }
 
 
@@ -194,11 +330,69 @@ string TpFanDriver::lookup()
 string TpFanDriver::type_name() const
 { return "tpacpi fan driver"; }
 
+string TpFanDriver::source() const
+{ return path_; }
+
+
+FanDriver::Feedback TpFanDriver::read_feedback()
+{
+	Feedback rv { nullopt, true };
+	char buf[512];
+	const char *end = buf + state_.read(buf, sizeof(buf));
+
+	auto is_key = [] (const char *line, const char *colon, const char *key) {
+		return size_t(colon - line) == std::strlen(key) && std::equal(line, colon, key);
+	};
+
+	for (const char *line = buf, *eol; line < end; line = eol + 1) {
+		eol = std::find(line, end, '\n');
+		const char *colon = std::find(line, eol, ':');
+		if (colon == eol)
+			continue;
+
+		const char *value = colon + 1;
+		int rpm;
+		if (is_key(line, colon, "speed")) {
+			if (parse_int(value, eol, rpm) && rpm >= 0)
+				rv.rpm = static_cast<unsigned int>(rpm);
+		}
+		else if (is_key(line, colon, "level")) {
+			value = std::find_if(value, eol, [] (char c) { return c != ' ' && c != '\t'; });
+			string level = "level " + string(value, std::find_if(value, eol, [] (char c) {
+				return c == ' ' || c == '\t' || c == '\0';
+			}));
+			// thinkpad_acpi reports full-speed as disengaged since it's the same EC setting
+			rv.confirmed = level == current_speed_
+				|| (level == "level disengaged" && current_speed_ == "level full-speed");
+		}
+	}
+
+	return rv;
+}
+
+
+bool TpFanDriver::should_spin() const
+{
+	// The EC may well keep the fan stopped in auto mode
+	return current_speed_ != "level 0" && current_speed_ != "level auto";
+}
+
 
 /*----------------------------------------------------------------------------
 | HwmonFanDriver: Driver for PWM fans, typically somewhere in sysfs.         |
 ----------------------------------------------------------------------------*/
 
+/// @brief The fan*_input that goes with a pwm* file, or an empty string if there's no such naming.
+static string tacho_path(const string &pwm_path)
+{
+	string::size_type name = pwm_path.find_last_of('/') + 1;
+	if (pwm_path.compare(name, 3, "pwm") != 0 || name + 3 == pwm_path.length()
+			|| pwm_path.find_first_not_of("0123456789", name + 3) != string::npos)
+		return "";
+	return pwm_path.substr(0, name) + "fan" + pwm_path.substr(name + 3) + "_input";
+}
+
+
 HwmonFanDriver::HwmonFanDriver(const string &path)
 : HwmonFanDriver(
 	std::make_shared<HwmonInterface<FanDriver>>(path, nullopt, nullopt, nullopt),
@@ -214,6 +408,7 @@ HwmonFanDriver::HwmonFanDriver(
 )
 : FanDriver(optional, 0, max_errors)
 , hwmon_interface_(hwmon_interface)
+, client_idx_(hwmon_interface->add_client())
 {}
 
 
@@ -238,6 +433,7 @@ HwmonFanDriver::~HwmonFanDriver() noexcept(false)
 
 void HwmonFanDriver::init()
 {
+	reset_output();
 	std::fstream f(path() + "_enable");
 	if (!(f.is_open() && f.good()))
 		throw IOerror(MSG_FAN_INIT(path()), errno);
@@ -253,26 +449,89 @@ void HwmonFanDriver::init()
 
 	if (!(f << "1" << std::flush))
 		throw IOerror(MSG_FAN_INIT(path()), errno);
+
+	enable_.open(path() + "_enable");
+
+	string tacho = tacho_path(path());
+	try {
+		if (tacho.empty())
+			tacho_.close();
+		else
+			tacho_.open(tacho);
+	} catch (IOerror &) {
+		tacho_.close();
+	}
+	if (!tacho_.is_open())
+		log(TF_DBG) << path() << ": No tachometer found." << flush;
 }
 
 string HwmonFanDriver::lookup()
-{ return hwmon_interface_->lookup(); }
+{ return hwmon_interface_->lookup(client_idx_); }
 
 string HwmonFanDriver::type_name() const
 { return "hwmon fan driver"; }
 
+string HwmonFanDriver::source() const
+{ return hwmon_interface_->source() + "\n" + std::to_string(client_idx_); }
+
+
+FanDriver::Feedback HwmonFanDriver::read_feedback()
+{
+	Feedback rv { nullopt, true };
+	char buf[16];
+	int value;
+
+	const char *p = buf;
+	size_t len = enable_.read(buf, sizeof(buf));
+	// init() sets pwm*_enable to 1 (manual control), so anything else means we've lost control.
+	if (parse_int(p, buf + len, value))
+		rv.confirmed = value == 1;
+
+	if (tacho_.is_open()) {
+		p = buf;
+		len = tacho_.read(buf, sizeof(buf));
+		if (parse_int(p, buf + len, value) && value >= 0)
+			rv.rpm = static_cast<unsigned int>(value);
+	}
+
+	return rv;
+}
+
+
+bool HwmonFanDriver::should_spin() const
+{ return current_speed_ != pwm_string(0); }
+
 
 void HwmonFanDriver::set_speed(const Level &level)
+{ set_pwm(level.num()); }
+
+
+string HwmonFanDriver::pwm_string(int pwm)
+{
+	static const vector<string> pwm_strings = [] {
+		vector<string> rv;
+		for (int i = 0; i < 256; ++i)
+			rv.push_back(std::to_string(i));
+		return rv;
+	}();
+
+	if (likely(pwm >= 0 && pwm < int(pwm_strings.size())))
+		return pwm_strings[size_t(pwm)];
+	return std::to_string(pwm);
+}
+
+
+void HwmonFanDriver::set_pwm(int pwm)
 {
 	try {
-		FanDriver::set_speed(std::to_string(level.num()));
+		FanDriver::set_speed(pwm_string(pwm));
 	} catch (IOerror &e) {
 		if (e.code() == EINVAL) {
 			// This happens when the hwmon kernel driver is reset to automatic control
 			// e.g. after the system has woken up from suspend.
 			// In that case, we need to re-initialize and try once more.
 			init();
-			FanDriver::set_speed(std::to_string(level.num()));
+			FanDriver::set_speed(pwm_string(pwm));
 			log(TF_WRN) << path() << ": WARNING: Userspace fan control had to be automatically re-initialized." << flush;
 #if defined(HAVE_SYSTEMD)
 			log(TF_WRN) << "This should have been taken care of when enabling the thinkfan systemd service." << flush
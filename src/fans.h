@@ -26,6 +26,7 @@
 #include "thinkfan.h"
 #include "driver.h"
 #include "hwmon.h"
+#include "persistent_file.h"
 
 namespace thinkfan {
 
@@ -41,20 +42,66 @@ public:
 	virtual void set_speed(const Level &level) = 0;
 	const string &current_speed() const;
 	virtual void ping_watchdog_and_depulse(const Level &) {}
+
+	/// @brief When the main loop must call end_depulse(), or nullopt if the fan isn't disengaged.
+	virtual opt<std::chrono::steady_clock::time_point> depulse_deadline() const;
+
+	/// @brief Re-engage the fan if its depulse deadline has passed at @a now.
+	virtual void end_depulse(std::chrono::steady_clock::time_point now);
+
+	/// @brief When the fan has to be written to again to keep its watchdog from expiring,
+	/// or nullopt if it doesn't have one.
+	opt<std::chrono::steady_clock::time_point> watchdog_deadline() const;
 	bool operator == (const FanDriver &other) const;
 
+	/// @brief Number of writes that were skipped because the fan was already at the requested speed.
+	unsigned long suppressed_writes() const;
+
+	/** @brief Read back what the fan is actually doing. Warn if it seems to have stalled, and take
+	 *  control back if the firmware has silently overridden the speed we set. Read errors are only
+	 *  logged. */
+	void sample_feedback();
+
+	/// @brief The RPM from the last sample_feedback(), or nullopt if the fan has no tachometer.
+	opt<unsigned int> rpm() const;
+
 protected:
+	struct Feedback {
+		opt<unsigned int> rpm;
+		/// @brief false if the fan isn't at current_speed_ anymore.
+		bool confirmed;
+	};
+
+	/// @brief Read the fan's tachometer and actual speed setting, if supported.
+	virtual Feedback read_feedback();
+
+	/// @brief Whether the fan should be turning at current_speed_.
+	virtual bool should_spin() const;
+
+	/** @brief Write @a level to the fan through a persistent fd. Skipped if the fan is already
+	 *  at @a level, unless a watchdog ping is due. */
 	void set_speed(const string &level);
 
+	/// @brief Close the fd and forget the current speed, so the next set_speed() always writes.
+	/// Must be called by init(), since the fan may have been reset (e.g. after suspend).
+	void reset_output();
+
 	string initial_state_;
 	string current_speed_;
 	seconds watchdog_;
 	secondsf depulse_;
-	std::chrono::system_clock::time_point last_watchdog_ping_;
+	std::chrono::steady_clock::time_point last_watchdog_ping_;
 
 private:
 	virtual void skip_io_error(const ExpectedError &e) override;
 	void set_speed_(const string &level);
+	bool watchdog_due_() const;
+
+	PersistentFile out_;
+	bool speed_known_;
+	unsigned long suppressed_writes_;
+	opt<unsigned int> rpm_;
+	unsigned int stalled_samples_;
 };
 
 
@@ -67,14 +114,23 @@ public:
 	void set_depulse(float duration);
 	virtual void set_speed(const Level &level) override;
 	virtual void ping_watchdog_and_depulse(const Level &level) override;
+	virtual opt<std::chrono::steady_clock::time_point> depulse_deadline() const override;
+	virtual void end_depulse(std::chrono::steady_clock::time_point now) override;
 
 protected:
 	virtual void init() override;
 	virtual string lookup() override;
 	virtual string type_name() const override;
+	virtual string source() const override;
+	virtual Feedback read_feedback() override;
+	virtual bool should_spin() const override;
 
 private:
 	const string path_;
+	PersistentFile state_;
+	opt<std::chrono::steady_clock::time_point> reengage_at_;
+	string reengage_level_;
+	std::chrono::steady_clock::time_point next_depulse_;
 };
 
 
@@ -90,14 +146,24 @@ public:
 
 	virtual ~HwmonFanDriver() noexcept(false) override;
 	virtual void set_speed(const Level &level) override;
+	void set_pwm(int pwm);
+
+	/// @brief The decimal representation of a PWM value, preformatted for 0..255
+	static string pwm_string(int pwm);
 
 protected:
 	virtual void init() override;
 	virtual string lookup() override;
 	virtual string type_name() const override;
+	virtual string source() const override;
+	virtual Feedback read_feedback() override;
+	virtual bool should_spin() const override;
 
 private:
 	shared_ptr<HwmonInterface<FanDriver>> hwmon_interface_;
+	const unsigned int client_idx_;
+	PersistentFile enable_;
+	PersistentFile tacho_;
 };
 
 
@@ -0,0 +1,111 @@
+/********************************************************************
+ * hotplug.cpp: Notice when devices are added
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "hotplug.h"
+#include "error.h"
+#include "message.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+namespace thinkfan {
+
+
+// The kernel's own uevents, as opposed to the ones udev re-broadcasts after processing them
+static constexpr uint32_t kernel_uevent_group = 1;
+
+
+HotplugMonitor::HotplugMonitor()
+: sock_(-1)
+{
+	if ((sock_ = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT)) < 0) {
+		string msg = strerror(errno);
+		throw SystemError("Failed to open uevent netlink socket: " + msg);
+	}
+
+	struct sockaddr_nl addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = kernel_uevent_group;
+	if (::bind(sock_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr))) {
+		string msg = strerror(errno);
+		::close(sock_);
+		throw SystemError("Failed to subscribe to uevents: " + msg);
+	}
+}
+
+
+HotplugMonitor::~HotplugMonitor()
+{
+	if (sock_ >= 0)
+		::close(sock_);
+}
+
+
+int HotplugMonitor::fd() const
+{ return sock_; }
+
+
+bool HotplugMonitor::handle_events()
+{
+	char buf[8192];
+	bool rv = false;
+
+	while (true) {
+		ssize_t len = ::recv(sock_, buf, sizeof(buf), MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS) {
+				// Socket buffer overrun, we may have missed something
+				rv = true;
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				log(TF_WRN) << "Reading uevents: " << strerror(errno) << flush;
+			break;
+		}
+		if (len == 0)
+			break;
+		rv |= parse_event(buf, size_t(len));
+	}
+
+	return rv;
+}
+
+
+bool HotplugMonitor::parse_event(const char *buf, size_t len)
+{
+	// Kernel uevents start with "ACTION@DEVPATH". Changes (e.g. of a battery's charge) are
+	// frequent and never make a missing device appear, so only additions count.
+	const char *at = static_cast<const char *>(std::memchr(buf, '@', std::min(len, size_t(16))));
+	if (!at)
+		return false;
+	const string action(buf, size_t(at - buf));
+	return action == "add" || action == "bind";
+}
+
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+/********************************************************************
+ * hotplug.h: Notice when devices are added
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "thinkfan.h"
+
+namespace thinkfan {
+
+
+/** @brief A netlink socket that receives the kernel's uevents, so drivers whose device is missing
+ *  can look for it again as soon as something shows up instead of waiting for their backoff. */
+class HotplugMonitor
+{
+public:
+	/// @brief Throws SystemError if the socket can't be opened.
+	HotplugMonitor();
+	~HotplugMonitor();
+	HotplugMonitor(const HotplugMonitor &) = delete;
+	HotplugMonitor(HotplugMonitor &&) = delete;
+
+	/// @return A non-blocking fd that becomes readable (POLLIN) when there are events.
+	int fd() const;
+
+	/** @brief Consume all pending events.
+	 *  @return true if a device was added or bound to a driver (or events were lost). */
+	bool handle_events();
+
+	/// @brief Check whether the uevent in @a len bytes of @a buf announces a new device.
+	static bool parse_event(const char *buf, size_t len);
+
+private:
+	int sock_;
+};
+
+
+}
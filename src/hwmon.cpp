@@ -22,11 +22,14 @@
 #include "hwmon.h"
 #include "message.h"
 #include "error.h"
+#include "config_cache.h"
 
 #include <fnmatch.h>
 #include <cstdio>
 #include <cassert>
 #include <cstring>
+#include <type_traits>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -48,6 +51,88 @@ static int filter_subdirs(const struct dirent *entry)
 }
 
 
+static vector<string> scan_dir(const string &path, int (*filter)(const struct dirent *),
+	int (*compar)(const struct dirent **, const struct dirent **))
+{
+	struct dirent **entries;
+	int nentries = ::scandir(path.c_str(), &entries, filter, compar);
+	if (nentries < 0)
+		throw IOerror("Error scanning " + path + ": ", errno);
+
+	vector<string> rv;
+	for (int i = 0; i < nentries; i++) {
+		rv.push_back(path + "/" + entries[i]->d_name);
+		free(entries[i]);
+	}
+	free(entries);
+	return rv;
+}
+
+
+
+SysfsIndex &SysfsIndex::instance()
+{
+	static SysfsIndex instance;
+	return instance;
+}
+
+
+const opt<string> &SysfsIndex::name(const string &dir)
+{
+	Dir &d = dirs_[dir];
+	if (!d.have_name) {
+		ifstream f(dir + "/name");
+		string tmp;
+		if (f.is_open() && f.good() && (f >> tmp))
+			d.name = tmp;
+		d.have_name = true;
+	}
+	return d.name;
+}
+
+
+const opt<string> &SysfsIndex::model(const string &dir)
+{
+	Dir &d = dirs_[dir];
+	if (!d.have_model) {
+		ifstream f(dir + "/model");
+		string tmp;
+		if (f.is_open() && f.good() && getline(f, tmp))
+			d.model = tmp.erase(tmp.find_last_not_of(" \t\n\r\f\v") + 1);
+		d.have_model = true;
+	}
+	return d.model;
+}
+
+
+const vector<string> &SysfsIndex::subdirs(const string &dir)
+{
+	Dir &d = dirs_[dir];
+	if (!d.subdirs) {
+		try {
+			d.subdirs = scan_dir(dir, filter_subdirs, nullptr);
+		} catch (IOerror &) {
+			d.subdirs.emplace();
+		}
+	}
+	return *d.subdirs;
+}
+
+
+const vector<string> &SysfsIndex::hwmon_dirs(const string &dir)
+{
+	Dir &d = dirs_[dir];
+	if (!d.hwmon_dirs)
+		d.hwmon_dirs = scan_dir(dir, filter_hwmon_dirs, alphasort);
+	return *d.hwmon_dirs;
+}
+
+
+void SysfsIndex::clear()
+{ dirs_.clear(); }
+
+
+
 template<class HwmonT>
 vector<string> HwmonInterface<HwmonT>::find_files(const string &path, const vector<unsigned int> &indices)
 {
@@ -75,6 +160,7 @@ string HwmonInterface<FanDriver>::filename(unsigned int index)
 
 template<class HwmonT>
 HwmonInterface<HwmonT>::HwmonInterface()
+: clients_(0)
 {}
 
 template<class HwmonT>
@@ -83,8 +169,25 @@ HwmonInterface<HwmonT>::HwmonInterface(const string &base_path, opt<const string
 , name_(name)
 , model_(model)
 , indices_(indices)
+, clients_(0)
 {}
 
+
+template<class HwmonT>
+unsigned int HwmonInterface<HwmonT>::add_client()
+{ return clients_++; }
+
+
+template<class HwmonT>
+string HwmonInterface<HwmonT>::source() const
+{
+	string rv = base_path_.value_or("") + "\n" + name_.value_or("") + "\n" + model_.value_or("");
+	if (indices_)
+		for (unsigned int idx : *indices_)
+			rv += "\n" + std::to_string(idx);
+	return rv;
+}
+
 template<class HwmonT>
 vector<string> HwmonInterface<HwmonT>::find_hwmons_by_name(
 	const string &path,
@@ -93,37 +196,20 @@ vector<string> HwmonInterface<HwmonT>::find_hwmons_by_name(
 ) {
 	const unsigned char max_depth = 5;
 	vector<string> result;
+	SysfsIndex &index = SysfsIndex::instance();
 
-	ifstream f(path + "/name");
-	if (f.is_open() && f.good()) {
-		string tmp;
-		if ((f >> tmp) && tmp == name) {
-			result.push_back(path);
-			return result;
-		}
+	if (index.name(path) == name) {
+		result.push_back(path);
+		return result;
 	}
 	if (depth >= max_depth) {
 		return result;  // don't recurse to subdirs
 	}
 
-	struct dirent **entries;
-	int nentries = ::scandir(path.c_str(), &entries, filter_subdirs, nullptr);
-	if (nentries == -1) {
-		return result;
-	}
-	for (int i = 0; i < nentries; i++) {
-		auto subdir = path + "/" + entries[i]->d_name;
-		free(entries[i]);
-
-		struct stat statbuf;
-		int err = stat(path.c_str(), &statbuf);
-		if (err || (statbuf.st_mode & S_IFMT) != S_IFDIR)
-			continue;
-
+	for (const string &subdir : index.subdirs(path)) {
 		auto found = find_hwmons_by_name(subdir, name, depth + 1);
 		result.insert(result.end(), found.begin(), found.end());
 	}
-	free(entries);
 
 	return result;
 }
@@ -136,40 +222,20 @@ vector<string> HwmonInterface<HwmonT>::find_hwmons_by_model(
 ) {
 	const unsigned char max_depth = 5;
 	vector<string> result;
+	SysfsIndex &index = SysfsIndex::instance();
 
-	ifstream f(path + "/model");
-	if (f.is_open() && f.good()) {
-		string tmp;
-		if (getline(f, tmp)) {
-			tmp = tmp.erase(tmp.find_last_not_of(" \t\n\r\f\v") + 1);
-			if (tmp == model) {
-				result.push_back(path);
-				return result;
-			}
-		}
+	if (index.model(path) == model) {
+		result.push_back(path);
+		return result;
 	}
 	if (depth >= max_depth) {
 		return result; // don't recurse to subdirs
 	}
 
-	struct dirent **entries;
-	int nentries = ::scandir(path.c_str(), &entries, filter_subdirs, nullptr);
-	if (nentries == -1) {
-		return result;
-	}
-	for (int i = 0; i < nentries; i++) {
-		auto subdir = path + "/" + entries[i]->d_name;
-		free(entries[i]);
-
-		struct stat statbuf;
-		int err = stat(path.c_str(), &statbuf);
-		if (err || (statbuf.st_mode & S_IFMT) != S_IFDIR)
-			continue;
-
+	for (const string &subdir : index.subdirs(path)) {
 		auto found = find_hwmons_by_model(subdir, model, depth + 1);
 		result.insert(result.end(), found.begin(), found.end());
 	}
-	free(entries);
 
 	return result;
 }
@@ -187,25 +253,12 @@ vector<string> HwmonInterface<HwmonT>::find_hwmons_by_indices(
 	}
 	catch (IOerror &) {
 		if (depth <= max_depth) {
-			struct dirent **entries;
-			int nentries = ::scandir(path.c_str(), &entries, filter_hwmon_dirs, alphasort);
-			if (nentries < 0)
-				throw IOerror("Error scanning " + path + ": ", errno);
-
 			vector<string> rv;
-			for (int i = 0; i < nentries; i++) {
-				rv = HwmonInterface<HwmonT>::find_hwmons_by_indices(
-					path + "/" + entries[i]->d_name,
-					indices,
-					depth + 1
-				);
+			for (const string &subdir : SysfsIndex::instance().hwmon_dirs(path)) {
+				rv = HwmonInterface<HwmonT>::find_hwmons_by_indices(subdir, indices, depth + 1);
 				if (rv.size())
 					break;
 			}
-			for (int i = 0; i < nentries; i++)
-				free(entries[i]);
-			free(entries);
-
 			return rv;
 		}
 		else
@@ -216,59 +269,113 @@ vector<string> HwmonInterface<HwmonT>::find_hwmons_by_indices(
 
 
 template<class HwmonT>
-string HwmonInterface<HwmonT>::lookup()
+string HwmonInterface<HwmonT>::lookup(unsigned int client_idx)
 {
-	if (!paths_it_) {
+	if (found_paths_.empty()) {
 		if (!base_path_)
 			throw Bug("Can't lookup sensor because it has no base path");
 
-		string path = *base_path_;
-
-		if (name_) {
-			vector<string> paths = find_hwmons_by_name(path, name_.value(), 1);
-			if (paths.size() != 1) {
-				string msg(path + ": ");
-				if (paths.size() == 0) {
-					msg += "Could not find a hwmon with this name: " + name_.value();
-				} else {
-					msg += MSG_MULTIPLE_HWMONS_FOUND;
-					for (string hwmon_path : paths)
-						msg += " " + hwmon_path;
-				}
-				throw DriverInitError(msg);
+		ConfigCache &cache = ConfigCache::instance();
+		auto start = std::chrono::steady_clock::now();
+
+		// Sensors and fans may be configured with the same options, but they look for different files
+		const string cache_key = string(std::is_same<HwmonT, FanDriver>::value ? "fan" : "sensor")
+			+ "\n" + source();
+		const ConfigCache::Lookup *cached = cache.find(
+			cache_key,
+			[this] (const ConfigCache::Lookup &c) { return cached_lookup_valid(c); }
+		);
+
+		if (cached)
+			found_paths_ = cached->paths;
+		else {
+			string resolved;
+			try {
+				resolved = resolve();
+			} catch (...) {
+				// Maybe the hwmon just isn't there yet, so the retry must look at sysfs again
+				SysfsIndex::instance().clear();
+				throw;
 			}
-			path = paths[0];
+			cache.store(cache_key, { resolved, found_paths_ });
 		}
-		if (model_) {
-			vector<string> paths = find_hwmons_by_model(path, model_.value(), 1);
-			if (paths.size() != 1) {
-				string msg(path + ": ");
-				if (paths.size() == 0) {
-					msg += "Could not find a hwmon with this model: " + model_.value();
-				} else {
-					msg += MSG_MULTIPLE_HWMONS_FOUND;
-					for (string hwmon_path : paths)
-						msg += " " + hwmon_path;
-				}
-				throw DriverInitError(msg);
+		cache.add_lookup_time(std::chrono::steady_clock::now() - start);
+	}
+
+	// By position, not by call order: After a reload, only some clients may need to look up their path
+	if (client_idx >= found_paths_.size())
+		throw Bug(string(__func__) + ": client index " + std::to_string(client_idx) + " out of bounds");
+
+	return found_paths_[client_idx];
+}
+
+
+template<class HwmonT>
+bool HwmonInterface<HwmonT>::cached_lookup_valid(const ConfigCache::Lookup &cached) const
+{
+	// The hwmon numbering may have changed since, e.g. if some kernel module was reloaded
+	auto first_line = [] (const string &path) {
+		ifstream f(path);
+		string rv;
+		getline(f, rv);
+		return rv.erase(rv.find_last_not_of(" \t\n\r\f\v") + 1);
+	};
+
+	if (name_ && first_line(cached.resolved + "/name") != *name_)
+		return false;
+	if (model_ && first_line(cached.resolved + "/model") != *model_)
+		return false;
+	for (const string &path : cached.paths)
+		if (::access(path.c_str(), F_OK))
+			return false;
+	return !cached.paths.empty();
+}
+
+
+template<class HwmonT>
+string HwmonInterface<HwmonT>::resolve()
+{
+	string path = *base_path_;
+
+	if (name_) {
+		vector<string> paths = find_hwmons_by_name(path, name_.value(), 1);
+		if (paths.size() != 1) {
+			string msg(path + ": ");
+			if (paths.size() == 0) {
+				msg += "Could not find a hwmon with this name: " + name_.value();
+			} else {
+				msg += MSG_MULTIPLE_HWMONS_FOUND;
+				for (string hwmon_path : paths)
+					msg += " " + hwmon_path;
 			}
-			path = paths[0];
+			throw DriverInitError(msg);
 		}
-		if (indices_) {
-			found_paths_ = find_hwmons_by_indices(path, indices_.value(), 0);
-			if (found_paths_.size() == 0)
-				throw DriverInitError(path + ": " + "Could not find any hwmons in " + path);
+		path = paths[0];
+	}
+	if (model_) {
+		vector<string> paths = find_hwmons_by_model(path, model_.value(), 1);
+		if (paths.size() != 1) {
+			string msg(path + ": ");
+			if (paths.size() == 0) {
+				msg += "Could not find a hwmon with this model: " + model_.value();
+			} else {
+				msg += MSG_MULTIPLE_HWMONS_FOUND;
+				for (string hwmon_path : paths)
+					msg += " " + hwmon_path;
+			}
+			throw DriverInitError(msg);
 		}
-		else
-			found_paths_.push_back(path);
-
-		paths_it_.emplace(found_paths_.begin());
+		path = paths[0];
 	}
+	if (indices_) {
+		found_paths_ = find_hwmons_by_indices(path, indices_.value(), 0);
+		if (found_paths_.size() == 0)
+			throw DriverInitError(path + ": " + "Could not find any hwmons in " + path);
+	}
+	else
+		found_paths_.push_back(path);
 
-	if (*paths_it_ >= found_paths_.end())
-		throw Bug(string(__func__) + ": found_paths_ iterator out of bounds");
-
-	return *paths_it_.value()++;
+	return path;
 }
 
 
@@ -25,6 +25,10 @@
 
 #include <dirent.h>
 
+#include "config_cache.h"
+
+#include <unordered_map>
+
 namespace thinkfan {
 
 
@@ -32,15 +36,69 @@ class HwmonSensorDriver;
 class HwmonFanDriver;
 
 
+/** @brief What the hwmon lookups have seen of sysfs so far. All HwmonInterfaces share it, so each
+ *  directory is listed and each name/model file is read only once, no matter how many sensors and
+ *  fans search the same subtree. Everything is read lazily on first use.
+ *  It's used whenever a driver needs to find its hwmon, i.e. on config init and also at runtime when a
+ *  missing driver is retried. Since devices may come and go, it must be cleared before anything that may
+ *  have to see new devices: It's cleared at the start of every config init, when a hotplug event makes
+ *  missing drivers look again (cf. retry_missing() in thinkfan.cpp), and whenever a lookup fails. */
+class SysfsIndex {
+public:
+	static SysfsIndex &instance();
+
+	/// @return The first word in @a dir/name, if there is such a file
+	const opt<string> &name(const string &dir);
+
+	/// @return The first line in @a dir/model without trailing whitespace, if there is such a file
+	const opt<string> &model(const string &dir);
+
+	/// @return All subdirectories of @a dir except for the `subsystem' backlink, empty on error
+	const vector<string> &subdirs(const string &dir);
+
+	/** @return The `hwmon*' and `device' subdirectories of @a dir in alphabetical order
+	 *  @throw IOerror if @a dir can't be listed */
+	const vector<string> &hwmon_dirs(const string &dir);
+
+	void clear();
+
+private:
+	SysfsIndex() = default;
+
+	struct Dir {
+		bool have_name = false;
+		bool have_model = false;
+		opt<string> name;
+		opt<string> model;
+		opt<vector<string>> subdirs;
+		opt<vector<string>> hwmon_dirs;
+	};
+
+	std::unordered_map<string, Dir> dirs_;
+};
+
+
 template<class HwmonT>
 class HwmonInterface {
 public:
 	HwmonInterface();
 	HwmonInterface(const string &base_path, opt<const string> name, opt<const string> model,  opt<vector<unsigned int>> indices);
 
-	string lookup();
+	/// @return The path for the driver that add_client() returned @a client_idx for.
+	string lookup(unsigned int client_idx);
+
+	/** @brief Register one more driver that will call lookup().
+	 *  @return Its position among the paths that lookup() finds. */
+	unsigned int add_client();
+
+	/// @brief The config options that identify this hwmon (cf. Driver::source()).
+	string source() const;
 
 private:
+	/// @brief Search for the hwmon and fill found_paths_. @return The hwmon directory.
+	string resolve();
+	bool cached_lookup_valid(const ConfigCache::Lookup &cached) const;
+
 	static vector<string> find_files(const string &path, const vector<unsigned int> &indices);
 	static string filename(unsigned int index);
 
@@ -54,7 +112,7 @@ protected:
 	opt<const string> model_;
 	opt<vector<unsigned int>> indices_;
 	vector<string> found_paths_;
-	opt<vector<string>::const_iterator> paths_it_;
+	unsigned int clients_;
 };
 
 
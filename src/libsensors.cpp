@@ -62,11 +62,11 @@ LibsensorsInterface::InitGuard::InitGuard(LMSensorsDriver *client)
 
 LibsensorsInterface::InitGuard::~InitGuard()
 {
-	if (iface_->libsensors_initialized_ && iface_->clients_[client_].features.empty()) {
+	if (iface_->libsensors_initialized_ && !iface_->clients_.count(client_)) {
 
 		// Make all clients unavailable (they have to lookup again!)
-		for (auto drv_entry : iface_->clients_)
-			drv_entry.first->set_unavailable();
+		for (LMSensorsDriver *drv : iface_->clients_)
+			drv->set_unavailable();
 		iface_->clients_.clear();
 
 		::sensors_cleanup();
@@ -89,12 +89,12 @@ shared_ptr<LibsensorsInterface> LibsensorsInterface::instance()
 }
 
 
-string LibsensorsInterface::lookup_client_features(LMSensorsDriver *client)
+string LibsensorsInterface::lookup_client_features(LMSensorsDriver *client, chip_features &cf)
 {
-	chip_features cf;
 	InitGuard ig(client);
 
 	cf.chip = find_chip_by_name(client->chip_name());
+	cf.features.clear();
 
 	for (const string& feature_name : client->feature_names()) {
 		auto feature = find_feature_by_name(*cf.chip, feature_name);
@@ -113,38 +113,35 @@ string LibsensorsInterface::lookup_client_features(LMSensorsDriver *client)
 			+ feature_name + "' of chip '" + client->chip_name() + "'." << flush;
 	}
 
-	clients_.insert({client, cf});
+	clients_.insert(client);
 	return cf.chip->path;
 }
 
 
-vector<double> LibsensorsInterface::get_temps(LMSensorsDriver *client)
-{
-	chip_features &cf = clients_.at(client);
-	vector<double> rv;
-
-	for (auto chip_feature : cf.features) {
-		auto sub_feature = chip_feature.second;
-		double real_value = MIN_CELSIUS_TEMP;
-
-		int err = ::sensors_get_value(cf.chip, sub_feature->number, &real_value);
-		if (err)
-			throw SystemError(
-				string("temperature input value of feature '") + chip_feature.first->name
-				+ "' of chip '" + client->chip_name()
-				+ "' is unavailable: " + ::sensors_strerror(err)
-			);
-		else if (real_value < MIN_CELSIUS_TEMP) // Make sure the reported value is physically valid.
-			throw SystemError(
-				string("Invalid temperature on feature '") + chip_feature.first->name
-				+ "' of chip '" + client->chip_name()
-				+ "': " + std::to_string(real_value)
-			);
-
-		rv.push_back(real_value);
-	}
+void LibsensorsInterface::remove_client(LMSensorsDriver *client)
+{ clients_.erase(client); }
 
-	return rv;
+
+int LibsensorsInterface::get_temp(const chip_features &cf, size_t index, const string &chip_name)
+{
+	const auto &chip_feature = cf.features[index];
+	double real_value = MIN_CELSIUS_TEMP;
+
+	int err = ::sensors_get_value(cf.chip, chip_feature.second->number, &real_value);
+	if (err)
+		throw SystemError(
+			string("temperature input value of feature '") + chip_feature.first->name
+			+ "' of chip '" + chip_name
+			+ "' is unavailable: " + ::sensors_strerror(err)
+		);
+	else if (real_value < MIN_CELSIUS_TEMP) // Make sure the reported value is physically valid.
+		throw SystemError(
+			string("Invalid temperature on feature '") + chip_feature.first->name
+			+ "' of chip '" + chip_name
+			+ "': " + std::to_string(real_value)
+		);
+
+	return int(real_value);
 }
 
 
@@ -26,7 +26,7 @@
 #ifdef USE_LM_SENSORS
 #include <sensors/sensors.h>
 #include <sensors/error.h>
-#include <map>
+#include <set>
 
 namespace thinkfan {
 
@@ -43,15 +43,21 @@ public:
 
 	static shared_ptr<LibsensorsInterface> instance();
 
-	string lookup_client_features(LMSensorsDriver *client);
-	vector<double> get_temps(LMSensorsDriver *client);
-
-private:
+	/// @brief The features of one chip, resolved once and owned by the @a LMSensorsDriver that uses them.
 	struct chip_features {
 		const ::sensors_chip_name *chip = nullptr;
 		vector<pair<const ::sensors_feature *, const ::sensors_subfeature *>> features;
 	};
 
+	/// @brief Resolve @a client's features into @a cf. @return The chip's sysfs path
+	string lookup_client_features(LMSensorsDriver *client, chip_features &cf);
+	void remove_client(LMSensorsDriver *client);
+
+	/// @return The temperature of feature number @a index in @a cf. Doesn't allocate unless there's an error.
+	static int get_temp(const chip_features &cf, size_t index, const string &chip_name);
+
+private:
+
 	/** @brief A scope guard to un-initialize libsensors when a requested feature/subfeature
 	 * isn't found. This is necessary because libsensors doesn't pick up kernel drivers that
 	 * are loaded after initialization. */
@@ -86,7 +92,7 @@ private:
 
 	static std::weak_ptr<LibsensorsInterface> instance_;
 
-	std::map<LMSensorsDriver *, chip_features> clients_;
+	std::set<LMSensorsDriver *> clients_;
 	bool libsensors_initialized_;
 };
 
@@ -172,13 +172,11 @@ Logger &Logger::operator<< (const TemperatureState &ts)
 {
 	msg_pfx_ += "Temperatures(bias): ";
 
-	vector<float>::const_iterator bias_it;
-	vector<int>::const_iterator temp_it;
+	const ArrayView<int> temps = ts.temps();
+	const ArrayView<float> biases = ts.biases();
 
-	for (temp_it = ts.temps().cbegin(), bias_it = ts.biases().cbegin();
-			temp_it != ts.temps().cend() && bias_it != ts.biases().cend();
-			++temp_it, ++bias_it)
-		msg_pfx_ += std::to_string(*temp_it) + "(" + std::to_string(int(*bias_it)) + "), ";
+	for (size_t i = 0; i < temps.size() && i < biases.size(); ++i)
+		msg_pfx_ += std::to_string(temps[i]) + "(" + std::to_string(int(biases[i])) + "), ";
 
 	msg_pfx_.pop_back(); msg_pfx_.pop_back();
 	return *this;
@@ -188,8 +186,12 @@ Logger &Logger::operator<< (const TemperatureState &ts)
 Logger &Logger::operator<< (const vector<unique_ptr<FanConfig>> &fan_configs)
 {
 	msg_pfx_ += "Fans: ";
-	for (const unique_ptr<FanConfig> &fan_cf : fan_configs)
-		msg_pfx_ += fan_cf->fan()->current_speed() + ", ";
+	for (const unique_ptr<FanConfig> &fan_cf : fan_configs) {
+		msg_pfx_ += fan_cf->fan()->current_speed();
+		if (opt<unsigned int> rpm = fan_cf->fan()->rpm())
+			msg_pfx_ += " (" + std::to_string(*rpm) + " RPM)";
+		msg_pfx_ += ", ";
+	}
 
 	msg_pfx_.pop_back(); msg_pfx_.pop_back();
 	return *this;
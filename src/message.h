@@ -120,9 +120,14 @@ template<class ErrT, class... ArgTs> void error(const ArgTs &... args) {
 #define MSG_TITLE "thinkfan " VERSION ": A minimalist fan control program"
 
 #define MSG_USAGE \
- "Usage: thinkfan [-hnqDd [-b BIAS] [-c CONFIG] [-s SECONDS] [-p [SECONDS]]]" \
+ "Usage: thinkfan [-hnqDd [-b BIAS] [-c CONFIG] [-s SECONDS] [-m SECONDS] [-i SECONDS] [-p [SECONDS]]" \
+ "\n                 [-t SECONDS]]" \
  "\n -h  This help message" \
- "\n -s  Maximum cycle time in seconds (Integer. Default: 5)" \
+ "\n -s  Maximum cycle time in seconds (0.1 ~ 15s). Default: 5" \
+ "\n -m  Cycle time in seconds while temperatures are rising quickly (0.1 ~ 15s)." \
+ "\n     Default: 2" \
+ "\n -i  Maximum cycle time in seconds while temperatures are stable (0.1 ~ 600s)." \
+ "\n     Default: Same as -s (disabled)" \
  "\n -b  Floating point number (-10 to 30) to control rising temperature" \
  "\n     exaggeration (see thinkfan(5)). Default: 0.0" \
  "\n -c  Load different configuration file (default: /etc/thinkfan.conf)" \
@@ -132,6 +137,8 @@ template<class ErrT, class... ArgTs> void error(const ArgTs &... args) {
  "\n -v  Enable verbose logging (e.g. log temperatures continuously)." \
  "\n -p  Use the pulsing-fan workaround (for worn out fans). Takes an optional" \
  "\n     floating-point argument (0 ~ 10s) as depulsing duration. Default 0.5s." \
+ "\n -t  How long to wait for slow sensors (GPUs, disks) in each cycle before" \
+ "\n     skipping them. Floating point seconds (0 ~ 60s). Default: 1.0" \
  DND_DISK_HELP \
  "\n -D  DANGEROUS mode: Disable all sanity checks. May result in undefined" \
  "\n     behaviour!\n"
@@ -161,7 +168,12 @@ template<class ErrT, class... ArgTs> void error(const ArgTs &... args) {
 #define MSG_T_GET(file) string(__func__) + ": Failed to read temperature(s) from " + file + ": "
 #define MSG_T_INVALID(s, d) s + ": Invalid temperature: " + std::to_string(d)
 #define MSG_SENSOR_INIT(file) string(__func__) + ": Initializing sensor in " + file + ": "
+#define MSG_SENSOR_NO_ALARM(file) "Cannot use alarms with " + file \
+	+ ": Need a temp*_input file with matching temp*_max and temp*_alarm (or temp*_max_alarm) attributes."
+#define MSG_SENSOR_ALARM_ERR(file) "Disabling alarms of " + file + " because they cannot be set: "
 #define MSG_MULTIPLE_HWMONS_FOUND "Found multiple hwmons with this name: "
+#define MSG_MULTIPLE_THERMAL_ZONES_FOUND(type) "Found multiple thermal zones with type " + type \
+	+ ", please specify the directory of the one to use:"
 
 
 #define MSG_FAN_MODOPTS \
@@ -174,18 +186,27 @@ template<class ErrT, class... ArgTs> void error(const ArgTs &... args) {
 #define MSG_FAN_RESET(fan) string(__func__) + ": Resetting fan control in " + fan + ": "
 #define MSG_FAN_EPERM(fan) string(__func__) + ": No permission to write to " + fan \
 	+ ". Thinkfan needs to be run as root!"
+#define MSG_FAN_OVERRIDDEN(fan, speed) fan + ": Fan is not at \"" + speed \
+	+ "\" anymore. Something else (probably the firmware) has taken over, re-initializing."
+#define MSG_FAN_STALLED(fan, speed) fan + ": Fan is not turning at \"" + speed \
+	+ "\". It may be stalled or blocked."
+#define MSG_FAN_UNSTALLED(fan, rpm) fan + ": Fan is turning again at " + std::to_string(rpm) + " RPM."
 
 
-#define MSG_OPT_S_15(t) std::to_string(t) + " seconds of not realizing "\
+#define MSG_OPT_S_MAX(t) std::to_string(t) + " seconds of not realizing "\
 	"rising temperatures may be dangerous!"
-#define MSG_OPT_S_1(t) "A sleeptime of " + std::to_string(t) + " seconds doesn't make much " \
+#define MSG_OPT_S_MIN(t) "A sleeptime of " + std::to_string(t) + " seconds doesn't make much " \
  "sense."
-#define MSG_OPT_S "option -s requires an int argument!"
-#define MSG_OPT_S_INVAL(x) string("invalid argument to option -s: ") + x
+#define MSG_OPT_S "option -s requires an argument!"
+#define MSG_OPT_M "option -m requires an argument!"
+#define MSG_OPT_I "option -i requires an argument!"
+#define MSG_OPT_S_INVAL(opt, x) string("invalid argument to option -") + opt + ": " + x
 #define MSG_OPT_B "bias must be between -10 and 30!"
 #define MSG_OPT_B_NOARG "option -b requires an argument!"
 #define MSG_OPT_B_INVAL(x) string("invalid argument to option -b: ") + x
 #define MSG_OPT_P(x) string("invalid argument to option -p: ") + x
+#define MSG_OPT_T_NOARG "option -t requires an argument!"
+#define MSG_OPT_T(x) string("invalid argument to option -t (must be between 0 and 60 seconds): ") + x
 
 
 #define MSG_CONF_DEFAULT_FAN "Using default fan control in " DEFAULT_FAN "."
@@ -231,6 +252,13 @@ template<class ErrT, class... ArgTs> void error(const ArgTs &... args) {
 
 #define MSG_CONF_MISSING_LOWER_LIMIT "You must specify a lower limit on all but the first fan level"
 #define MSG_CONF_MISSING_UPPER_LIMIT "You must specify an upper limit on all but the last fan level"
+#define MSG_CONF_CURVE_EMPTY "A fan curve needs at least one point"
+#define MSG_CONF_CURVE_ORDER "The temperatures of a fan curve must be strictly increasing"
+#define MSG_CONF_CURVE_PWM(pwm) std::to_string(pwm) + " is not a valid PWM value (must be 0 to 255)"
+#define MSG_CONF_CURVE_FAN "A fan curve can only be used with a hwmon (PWM) fan"
+#define MSG_CONF_PID_FAN "A PID controller can only be used with a hwmon (PWM) fan"
+#define MSG_CONF_PID_RANGE(min, max) "Invalid PID output range [" + std::to_string(min) + ", " \
+	+ std::to_string(max) + "] (must be within 0 to 255)"
 
 
 #endif
@@ -0,0 +1,155 @@
+/********************************************************************
+ * nvml.cpp: State management for the nVidia Management Library
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "nvml.h"
+
+#ifdef USE_NVML
+
+#include "error.h"
+#include "message.h"
+
+#include <cstring>
+#include <dlfcn.h>
+
+namespace thinkfan {
+
+std::weak_ptr<NvmlInterface> NvmlInterface::instance_;
+
+
+NvmlInterface::NvmlInterface()
+: nvml_initialized_(false),
+  dl_nvmlInit_v2(nullptr),
+  dl_nvmlDeviceGetHandleByPciBusId_v2(nullptr),
+  dl_nvmlDeviceGetName(nullptr),
+  dl_nvmlDeviceGetTemperature(nullptr),
+  dl_nvmlShutdown(nullptr)
+{
+	if (!(so_handle_ = dlopen("libnvidia-ml.so.1", RTLD_LAZY))) {
+		string msg = dlerror();
+		throw SystemError("Failed to load libnvidia-ml.so.1: " + msg);
+	}
+
+	/* Apparently GCC doesn't want to cast to function pointers, so we have to do
+	 * this kind of weird stuff.
+	 * See http://stackoverflow.com/questions/1096341/function-pointers-casting-in-c
+	 */
+	*reinterpret_cast<void **>(&dl_nvmlInit_v2) = dlsym(so_handle_, "nvmlInit_v2");
+	*reinterpret_cast<void **>(&dl_nvmlDeviceGetHandleByPciBusId_v2) = dlsym(
+			so_handle_, "nvmlDeviceGetHandleByPciBusId_v2");
+	*reinterpret_cast<void **>(&dl_nvmlDeviceGetName) = dlsym(so_handle_, "nvmlDeviceGetName");
+	*reinterpret_cast<void **>(&dl_nvmlDeviceGetTemperature) = dlsym(so_handle_, "nvmlDeviceGetTemperature");
+	*reinterpret_cast<void **>(&dl_nvmlShutdown) = dlsym(so_handle_, "nvmlShutdown");
+
+	if (!(dl_nvmlDeviceGetHandleByPciBusId_v2 && dl_nvmlDeviceGetName &&
+			dl_nvmlDeviceGetTemperature && dl_nvmlInit_v2 && dl_nvmlShutdown)) {
+		dlclose(so_handle_);
+		throw SystemError("Incompatible NVML driver.");
+	}
+
+	log(TF_DBG) << "Loaded NVML library." << flush;
+}
+
+
+NvmlInterface::~NvmlInterface()
+{
+	nvmlReturn_t ret;
+	if (nvml_initialized_ && (ret = dl_nvmlShutdown()))
+		log(TF_ERR) << "Failed to shutdown NVML driver. Error code (cf. nvml.h): " << std::to_string(ret) << flush;
+	dlclose(so_handle_);
+}
+
+
+shared_ptr<NvmlInterface> NvmlInterface::instance()
+{
+	shared_ptr<NvmlInterface> rv;
+	if (instance_.expired()) {
+		rv.reset(new NvmlInterface());
+		instance_ = rv;
+	}
+	else
+		rv = instance_.lock();
+
+	return rv;
+}
+
+
+string NvmlInterface::lookup_device(const string &bus_id)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	nvmlReturn_t ret;
+
+	if (!nvml_initialized_) {
+		if ((ret = dl_nvmlInit_v2()))
+			throw SystemError("Failed to initialize NVML driver. Error code (cf. nvml.h): " + std::to_string(ret));
+		nvml_initialized_ = true;
+	}
+
+	auto it = devices_.find(bus_id);
+	if (it == devices_.end()) {
+		device dev;
+		if ((ret = dl_nvmlDeviceGetHandleByPciBusId_v2(bus_id.c_str(), &dev.handle)))
+			throw SystemError("Failed to open PCI device " + bus_id + ". Error code (cf. nvml.h): " + std::to_string(ret));
+		it = devices_.insert({bus_id, dev}).first;
+	}
+
+	string name;
+	name.resize(256);
+	dl_nvmlDeviceGetName(it->second.handle, &*name.begin(), 255);
+	name.resize(std::strlen(name.c_str()));
+	return name;
+}
+
+
+void NvmlInterface::read_all_()
+{
+	for (auto &entry : devices_) {
+		device &dev = entry.second;
+		dev.err = dl_nvmlDeviceGetTemperature(dev.handle, NVML_TEMPERATURE_GPU, &dev.temp);
+		dev.fresh = true;
+	}
+	last_pass_ = std::chrono::steady_clock::now();
+}
+
+
+unsigned int NvmlInterface::get_temp(const string &bus_id)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto it = devices_.find(bus_id);
+	if (it == devices_.end())
+		throw Bug("NvmlInterface: get_temp() on unknown device " + bus_id);
+	device &dev = it->second;
+
+	// A temperature from the current pass is used only once, and only within the same loop.
+	// Everything else triggers a new pass.
+	if (!dev.fresh || std::chrono::steady_clock::now() - last_pass_ > read_deadline)
+		read_all_();
+	dev.fresh = false;
+
+	if (dev.err)
+		throw SystemError(MSG_T_GET(bus_id) + "Error code (cf. nvml.h): " + std::to_string(dev.err));
+	return dev.temp;
+}
+
+
+}
+
+#endif /* USE_NVML */
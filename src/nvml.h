@@ -0,0 +1,83 @@
+/********************************************************************
+ * nvml.h: State management for the nVidia Management Library
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#pragma once
+
+#include "thinkfan.h"
+
+#ifdef USE_NVML
+#include <nvidia/gdk/nvml.h>
+#include <map>
+#include <mutex>
+
+namespace thinkfan {
+
+/** @brief Loads libnvidia-ml.so once and keeps it initialized for as long as any
+ * @a NvmlSensorDriver holds a reference to it. Device handles are looked up once per PCI bus ID.
+ * When one GPU is read, all known GPUs are read in the same pass, so the other drivers just
+ * pick up their temperature instead of going through the driver again. */
+class NvmlInterface
+{
+public:
+	~NvmlInterface();
+	NvmlInterface(const NvmlInterface &) = delete;
+	NvmlInterface(NvmlInterface &&) = delete;
+
+	static shared_ptr<NvmlInterface> instance();
+
+	/// @return The name of the GPU at @a bus_id
+	string lookup_device(const string &bus_id);
+
+	/// @brief Thread-safe, since NVML sensors are read on worker threads.
+	unsigned int get_temp(const string &bus_id);
+
+private:
+	struct device {
+		nvmlDevice_t handle;
+		nvmlReturn_t err = NVML_SUCCESS;
+		unsigned int temp = 0;
+		bool fresh = false;
+	};
+
+	NvmlInterface();
+
+	void read_all_();
+
+	static std::weak_ptr<NvmlInterface> instance_;
+
+	void *so_handle_;
+	bool nvml_initialized_;
+	std::map<string, device> devices_;
+	std::chrono::steady_clock::time_point last_pass_;
+	std::mutex mutex_;
+
+	// Pointers to dynamically loaded functions from libnvidia-ml.so
+	nvmlReturn_t (*dl_nvmlInit_v2)();
+	nvmlReturn_t (*dl_nvmlDeviceGetHandleByPciBusId_v2)(const char *, nvmlDevice_t *);
+	nvmlReturn_t (*dl_nvmlDeviceGetName)(nvmlDevice_t, char *, unsigned int);
+	nvmlReturn_t (*dl_nvmlDeviceGetTemperature)(nvmlDevice_t, nvmlTemperatureSensors_t, unsigned int *);
+	nvmlReturn_t (*dl_nvmlShutdown)();
+};
+
+
+}
+
+#endif /* USE_NVML */
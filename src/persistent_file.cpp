@@ -0,0 +1,167 @@
+/********************************************************************
+ * persistent_file.cpp: Long-lived file descriptors for sysfs/procfs I/O
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "persistent_file.h"
+#include "error.h"
+
+#include <unistd.h>
+#include <cerrno>
+
+namespace thinkfan {
+
+
+PersistentFile::PersistentFile(int flags)
+: flags_(flags | O_CLOEXEC)
+, fd_(-1)
+{}
+
+PersistentFile::~PersistentFile()
+{ close(); }
+
+
+void PersistentFile::open(const string &path)
+{
+	close();
+	path_ = path;
+	reopen_();
+}
+
+
+void PersistentFile::reopen_()
+{
+	close();
+	int fd;
+	do
+		fd = ::open(path_.c_str(), flags_);
+	while (fd < 0 && errno == EINTR);
+
+	if (fd < 0)
+		throw IOerror(path_ + ": ", errno);
+	fd_ = fd;
+}
+
+
+void PersistentFile::close()
+{
+	if (fd_ >= 0) {
+		::close(fd_);
+		fd_ = -1;
+	}
+}
+
+
+bool PersistentFile::is_open() const
+{ return fd_ >= 0; }
+
+int PersistentFile::fd() const
+{ return fd_; }
+
+const string &PersistentFile::path() const
+{ return path_; }
+
+
+size_t PersistentFile::read(char *buf, size_t len)
+{
+	bool reopened = false;
+
+	if (unlikely(fd_ < 0)) {
+		reopen_();
+		reopened = true;
+	}
+
+	while (true) {
+		ssize_t rv = ::pread(fd_, buf, len, 0);
+		if (likely(rv >= 0))
+			return size_t(rv);
+
+		int err = errno;
+		if (err == EINTR)
+			continue;
+		if ((err == ENODEV || err == ESTALE) && !reopened) {
+			// Device was unbound and possibly re-bound under the same path
+			reopen_();
+			reopened = true;
+			continue;
+		}
+		throw IOerror(path_ + ": ", err);
+	}
+}
+
+
+void PersistentFile::write(const char *buf, size_t len)
+{
+	bool reopened = false;
+
+	if (unlikely(fd_ < 0)) {
+		reopen_();
+		reopened = true;
+	}
+
+	while (true) {
+		ssize_t rv = ::pwrite(fd_, buf, len, 0);
+		if (likely(rv >= 0))
+			return;
+
+		int err = errno;
+		if (err == EINTR)
+			continue;
+		if ((err == ENODEV || err == ESTALE) && !reopened) {
+			reopen_();
+			reopened = true;
+			continue;
+		}
+		throw IOerror(path_ + ": ", err);
+	}
+}
+
+
+
+bool parse_int(const char *&p, const char *end, int &value)
+{
+	const char *c = p;
+	while (c < end && (*c == ' ' || *c == '\t' || *c == '\n'))
+		++c;
+
+	bool negative = false;
+	if (c < end && (*c == '-' || *c == '+'))
+		negative = *c++ == '-';
+
+	if (c >= end || *c < '0' || *c > '9')
+		return false;
+
+	long long acc = 0;
+	for (; c < end && *c >= '0' && *c <= '9'; ++c) {
+		acc = acc * 10 + (*c - '0');
+		if (unlikely(acc > static_cast<long long>(numeric_limits<int>::max()) + 1))
+			return false;
+	}
+	if (negative)
+		acc = -acc;
+	if (unlikely(acc > numeric_limits<int>::max()))
+		return false;
+
+	value = int(acc);
+	p = c;
+	return true;
+}
+
+
+} // namespace thinkfan
@@ -0,0 +1,71 @@
+#pragma once
+
+/********************************************************************
+ * persistent_file.h: Long-lived file descriptors for sysfs/procfs I/O
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "thinkfan.h"
+
+#include <fcntl.h>
+
+namespace thinkfan {
+
+
+/** @brief An fd that stays open across loop iterations.
+ *  sysfs/procfs attributes regenerate their content on every read from offset 0, so there's no
+ *  need to open/close them each time. If the underlying device goes away (ENODEV/ESTALE), the file
+ *  is transparently re-opened once before an IOerror is thrown. */
+class PersistentFile {
+public:
+	PersistentFile(int flags = O_RDONLY);
+	~PersistentFile();
+
+	PersistentFile(const PersistentFile &) = delete;
+	PersistentFile &operator = (const PersistentFile &) = delete;
+
+	void open(const string &path);
+	void close();
+	bool is_open() const;
+	int fd() const;
+	const string &path() const;
+
+	/** @brief pread() at offset 0, re-opening the file once if the device has gone stale.
+	 *  @return The number of bytes read. Throws IOerror on failure. */
+	size_t read(char *buf, size_t len);
+
+	/// @brief pwrite() at offset 0, with the same error handling as @a read().
+	void write(const char *buf, size_t len);
+
+private:
+	void reopen_();
+
+	string path_;
+	int flags_;
+	int fd_;
+};
+
+
+/** @brief Parse a (possibly signed) decimal integer from [@a p, @a end), skipping leading whitespace.
+ *  On success, @a p is advanced past the last digit.
+ *  @return false if no digits were found or the value doesn't fit into an int. */
+bool parse_int(const char *&p, const char *end, int &value);
+
+
+} // namespace thinkfan
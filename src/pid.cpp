@@ -0,0 +1,91 @@
+/********************************************************************
+ * pid.cpp: Fixed-point PID controller for closed-loop fan control
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "pid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace thinkfan {
+
+
+PidController::PidController(int target, float kp, float ki, float kd, int out_min, int out_max, unsigned int deadband)
+: target_(target),
+  kp_(to_fixed(kp)),
+  ki_(to_fixed(ki)),
+  kd_(to_fixed(kd)),
+  out_min_(out_min),
+  out_max_(out_max),
+  deadband_(int(deadband)),
+  integral_(fixed(out_min) << frac_bits),
+  prev_temp_(0),
+  have_prev_(false)
+{}
+
+
+PidController::fixed PidController::to_fixed(float f)
+{ return fixed(std::lround(f * (1 << frac_bits))); }
+
+
+void PidController::reset(int output)
+{
+	integral_ = fixed(std::min(std::max(output, out_min_), out_max_)) << frac_bits;
+	have_prev_ = false;
+}
+
+
+int PidController::step(int temp, unsigned int dt_ms)
+{
+	const fixed lo = fixed(out_min_) << frac_bits;
+	const fixed hi = fixed(out_max_) << frac_bits;
+	const fixed err = std::abs(temp - target_) <= deadband_ ? 0 : temp - target_;
+	const fixed dt = std::max(dt_ms, 1u);
+
+	fixed derivative = 0;
+	if (have_prev_)
+		derivative = kd_ * (temp - prev_temp_) * 1000 / dt;
+	prev_temp_ = temp;
+	have_prev_ = true;
+
+	fixed integral = std::min(std::max(integral_ + ki_ * err * dt / 1000, lo), hi);
+	fixed out = kp_ * err + integral + derivative;
+
+	// Anti-windup: Don't integrate further while the output is already saturated in that direction
+	if (!((out > hi && err > 0) || (out < lo && err < 0)))
+		integral_ = integral;
+
+	out = std::min(std::max(out, lo), hi);
+	return int((out + (fixed(1) << (frac_bits - 1))) >> frac_bits);
+}
+
+
+int PidController::target() const
+{ return target_; }
+
+int PidController::out_min() const
+{ return out_min_; }
+
+int PidController::out_max() const
+{ return out_max_; }
+
+
+} // namespace thinkfan
@@ -0,0 +1,70 @@
+#pragma once
+
+/********************************************************************
+ * pid.h: Fixed-point PID controller for closed-loop fan control
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include <cstdint>
+
+namespace thinkfan {
+
+
+/** @brief Computes a fan output that holds a temperature at @a target.
+ *  All math is done in 48.16 fixed point. The integral term is clamped to the output range and
+ *  isn't accumulated while the output is saturated in the direction of the error (anti-windup).
+ *  The derivative is taken on the temperature, so it doesn't kick when the target changes.
+ *  This class does no I/O at all, so tuning can be tested against a simulated thermal plant. */
+class PidController {
+public:
+	/// @param kp Output units per °C of error
+	/// @param ki Output units per °C of error and second
+	/// @param kd Output units per °C/s of temperature change
+	/// @param deadband Errors up to this many °C are treated as zero, so sensor noise doesn't move the output
+	PidController(int target, float kp, float ki, float kd, int out_min, int out_max, unsigned int deadband);
+
+	/// @brief Forget the temperature history and start with the integral term at @a output.
+	void reset(int output);
+
+	/// @brief Advance the controller by @a dt_ms milliseconds with the current temperature @a temp.
+	/// @return The new output, within [out_min, out_max].
+	int step(int temp, unsigned int dt_ms);
+
+	int target() const;
+	int out_min() const;
+	int out_max() const;
+
+private:
+	using fixed = int64_t;
+	static constexpr int frac_bits = 16;
+
+	static fixed to_fixed(float f);
+
+	int target_;
+	fixed kp_, ki_, kd_;
+	int out_min_, out_max_;
+	int deadband_;
+
+	fixed integral_;
+	int prev_temp_;
+	bool have_prev_;
+};
+
+
+} // namespace thinkfan
@@ -0,0 +1,507 @@
+/********************************************************************
+ * sampler.cpp: Reading all configured sensors in one go
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "sampler.h"
+#include "sensors.h"
+#include "error.h"
+#include "message.h"
+
+#include <algorithm>
+#include <csignal>
+#include <pthread.h>
+
+#ifdef USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace thinkfan {
+
+
+#ifdef USE_IO_URING
+
+/*----------------------------------------------------------------------------
+| IoUring: Just enough of an io_uring to submit a batch of reads and wait    |
+| for all of them. Talks to the kernel directly so we don't need liburing.   |
+----------------------------------------------------------------------------*/
+
+class IoUring {
+public:
+	using CompleteFn = std::function<void (unsigned int tag, int result)>;
+
+	IoUring(unsigned int entries);
+	~IoUring();
+
+	unsigned int capacity() const;
+	unsigned int queued() const;
+
+	void queue_read(int fd, char *buf, unsigned int len, unsigned int tag);
+
+	/** @brief Submit everything that has been queued and wait until all of it has completed.
+	 *  @param complete_fn Called with (tag, result) for each completed read, where result is the
+	 *  number of bytes read or -errno. */
+	void submit_and_wait(const CompleteFn &complete_fn);
+
+private:
+	unsigned int reap_(const CompleteFn &complete_fn);
+	void cleanup_();
+
+	int fd_;
+	unsigned int entries_;
+	unsigned int queued_;
+
+	void *sq_ring_;
+	size_t sq_ring_sz_;
+	void *cq_ring_;
+	size_t cq_ring_sz_;
+	io_uring_sqe *sqes_;
+	size_t sqes_sz_;
+
+	unsigned int *sq_head_;
+	unsigned int *sq_tail_;
+	unsigned int sq_mask_;
+	unsigned int *sq_array_;
+
+	unsigned int *cq_head_;
+	unsigned int *cq_tail_;
+	unsigned int cq_mask_;
+	io_uring_cqe *cqes_;
+};
+
+
+static int sys_io_uring_setup(unsigned int entries, io_uring_params *p)
+{ return int(::syscall(__NR_io_uring_setup, entries, p)); }
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{ return int(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0)); }
+
+
+IoUring::IoUring(unsigned int entries)
+: fd_(-1)
+, queued_(0)
+, sq_ring_(MAP_FAILED)
+, cq_ring_(MAP_FAILED)
+, sqes_(static_cast<io_uring_sqe *>(MAP_FAILED))
+{
+	io_uring_params p;
+	std::memset(&p, 0, sizeof(p));
+
+	if ((fd_ = sys_io_uring_setup(entries, &p)) < 0) {
+		string msg = std::strerror(errno);
+		throw SystemError("io_uring_setup: " + msg);
+	}
+	entries_ = p.sq_entries;
+
+	sq_ring_sz_ = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	cq_ring_sz_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		sq_ring_sz_ = cq_ring_sz_ = std::max(sq_ring_sz_, cq_ring_sz_);
+	sqes_sz_ = p.sq_entries * sizeof(io_uring_sqe);
+
+	sq_ring_ = ::mmap(nullptr, sq_ring_sz_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+	if (sq_ring_ == MAP_FAILED) {
+		string msg = std::strerror(errno);
+		cleanup_();
+		throw SystemError("io_uring: mmap(SQ): " + msg);
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		cq_ring_ = sq_ring_;
+	else {
+		cq_ring_ = ::mmap(nullptr, cq_ring_sz_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+		if (cq_ring_ == MAP_FAILED) {
+			string msg = std::strerror(errno);
+			cleanup_();
+			throw SystemError("io_uring: mmap(CQ): " + msg);
+		}
+	}
+
+	sqes_ = static_cast<io_uring_sqe *>(::mmap(
+		nullptr, sqes_sz_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES
+	));
+	if (sqes_ == MAP_FAILED) {
+		string msg = std::strerror(errno);
+		cleanup_();
+		throw SystemError("io_uring: mmap(SQEs): " + msg);
+	}
+
+	char *sq = static_cast<char *>(sq_ring_);
+	sq_head_ = reinterpret_cast<unsigned int *>(sq + p.sq_off.head);
+	sq_tail_ = reinterpret_cast<unsigned int *>(sq + p.sq_off.tail);
+	sq_mask_ = *reinterpret_cast<unsigned int *>(sq + p.sq_off.ring_mask);
+	sq_array_ = reinterpret_cast<unsigned int *>(sq + p.sq_off.array);
+
+	char *cq = static_cast<char *>(cq_ring_);
+	cq_head_ = reinterpret_cast<unsigned int *>(cq + p.cq_off.head);
+	cq_tail_ = reinterpret_cast<unsigned int *>(cq + p.cq_off.tail);
+	cq_mask_ = *reinterpret_cast<unsigned int *>(cq + p.cq_off.ring_mask);
+	cqes_ = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+}
+
+
+IoUring::~IoUring()
+{ cleanup_(); }
+
+
+void IoUring::cleanup_()
+{
+	if (sqes_ != MAP_FAILED)
+		::munmap(sqes_, sqes_sz_);
+	if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+		::munmap(cq_ring_, cq_ring_sz_);
+	if (sq_ring_ != MAP_FAILED)
+		::munmap(sq_ring_, sq_ring_sz_);
+	if (fd_ >= 0)
+		::close(fd_);
+
+	sqes_ = static_cast<io_uring_sqe *>(MAP_FAILED);
+	sq_ring_ = cq_ring_ = MAP_FAILED;
+	fd_ = -1;
+}
+
+
+unsigned int IoUring::capacity() const
+{ return entries_; }
+
+unsigned int IoUring::queued() const
+{ return queued_; }
+
+
+void IoUring::queue_read(int fd, char *buf, unsigned int len, unsigned int tag)
+{
+	if (queued_ >= entries_)
+		throw Bug("io_uring submission queue overflow");
+
+	unsigned int tail = *sq_tail_;
+	unsigned int idx = tail & sq_mask_;
+
+	io_uring_sqe &sqe = sqes_[idx];
+	std::memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = IORING_OP_READ;
+	sqe.fd = fd;
+	sqe.off = 0;
+	sqe.addr = reinterpret_cast<unsigned long>(buf);
+	sqe.len = len;
+	sqe.user_data = tag;
+
+	sq_array_[idx] = idx;
+	__atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+	++queued_;
+}
+
+
+void IoUring::submit_and_wait(const CompleteFn &complete_fn)
+{
+	unsigned int pending = queued_;
+	queued_ = 0;
+
+	while (pending > 0) {
+		unsigned int to_submit = *sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+		if (sys_io_uring_enter(fd_, to_submit, pending, IORING_ENTER_GETEVENTS) < 0
+				&& errno != EINTR && errno != EAGAIN) {
+			string msg = std::strerror(errno);
+			throw SystemError("io_uring_enter: " + msg);
+		}
+		pending -= reap_(complete_fn);
+	}
+}
+
+
+unsigned int IoUring::reap_(const CompleteFn &complete_fn)
+{
+	unsigned int count = 0;
+	unsigned int head = *cq_head_;
+
+	while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+		const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+		unsigned int tag = static_cast<unsigned int>(cqe.user_data);
+		int res = cqe.res;
+
+		// Release the CQE before handing it out, so the ring stays consistent if complete_fn throws
+		__atomic_store_n(cq_head_, ++head, __ATOMIC_RELEASE);
+		++count;
+
+		complete_fn(tag, res);
+	}
+
+	return count;
+}
+
+#endif // USE_IO_URING
+
+
+
+/*----------------------------------------------------------------------------
+| SensorSampler                                                              |
+----------------------------------------------------------------------------*/
+
+#ifdef USE_IO_URING
+// Large enough for any single sysfs attribute and for /proc/acpi/ibm/thermal
+static constexpr size_t batch_buf_size = TpSensorDriver::max_data_size;
+
+// Never allocate more than this many SQEs, even for huge configs. We just submit in chunks.
+static constexpr unsigned int max_ring_entries = 256;
+#endif
+
+// Blocking drivers are mostly GPUs and disks. There's no point in having more threads than that.
+static constexpr size_t max_workers = 4;
+
+
+SensorSampler::SensorSampler(const vector<unique_ptr<SensorDriver>> &sensors)
+: sensors_(sensors)
+, due_(sensors.size(), true)
+, stop_(false)
+{
+	for (size_t i = 0; i < sensors_.size(); ++i)
+		if (sensors_[i]->blocking())
+			slow_.push_back({ sensors_[i].get(), i, false, false, SlowSensor::NONE });
+
+	if (!slow_.empty()) {
+		// Signals must be handled by the main thread, so block them in the workers (except for the
+		// synchronous ones, which are always delivered to the faulting thread anyway).
+		sigset_t all, old;
+		sigfillset(&all);
+		sigdelset(&all, SIGSEGV);
+		pthread_sigmask(SIG_BLOCK, &all, &old);
+		for (size_t i = 0; i < std::min(slow_.size(), max_workers); ++i)
+			workers_.emplace_back(&SensorSampler::work_, this);
+		pthread_sigmask(SIG_SETMASK, &old, nullptr);
+	}
+
+#ifdef USE_IO_URING
+	unsigned int entries = 1;
+	while (entries < sensors_.size() && entries < max_ring_entries)
+		entries <<= 1;
+
+	try {
+		ring_ = std::make_unique<IoUring>(entries);
+		buffers_.resize(sensors_.size() * batch_buf_size);
+		batched_.reserve(sensors_.size());
+		log(TF_DBG) << "Using io_uring to batch sensor reads." << flush;
+	} catch (SystemError &e) {
+		log(TF_DBG) << e.what() << ". Falling back to synchronous sensor reads." << flush;
+	}
+#endif
+}
+
+
+SensorSampler::~SensorSampler()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	work_cond_.notify_all();
+
+	// A worker may still be stuck in a driver, but we must not destroy the config before it's done.
+	for (std::thread &worker : workers_)
+		worker.join();
+}
+
+
+void SensorSampler::read_temps()
+{
+	std::fill(due_.begin(), due_.end(), true);
+	read_due_temps_();
+}
+
+
+void SensorSampler::read_temps(const vector<bool> &due)
+{
+	due_ = due;
+	read_due_temps_();
+}
+
+
+void SensorSampler::read_due_temps_()
+{
+	auto deadline = std::chrono::steady_clock::now()
+		+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(read_deadline);
+
+	dispatch_slow_();
+	read_fast_temps_();
+	collect_slow_(deadline);
+}
+
+
+void SensorSampler::read_fast_temps_()
+{
+#ifdef USE_IO_URING
+	if (ring_) {
+		read_fast_temps_batched_();
+		return;
+	}
+#endif
+	for (size_t i = 0; i < sensors_.size(); ++i)
+		if (due_[i] && !sensors_[i]->blocking())
+			sensors_[i]->read_temps();
+}
+
+
+void SensorSampler::dispatch_slow_()
+{
+	if (slow_.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (SlowSensor &s : slow_) {
+			// Drivers that need to be (re-)initialized are handled synchronously in collect_slow_()
+			if (due_[s.index] && !s.in_flight && s.driver->available() && s.driver->initialized()) {
+				s.in_flight = true;
+				s.done = false;
+				queue_.push_back(&s);
+			}
+		}
+	}
+	work_cond_.notify_all();
+}
+
+
+void SensorSampler::collect_slow_(std::chrono::steady_clock::time_point deadline)
+{
+	if (slow_.empty())
+		return;
+
+	// Decide what to do with each sensor under the lock, but do it without holding the lock
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		done_cond_.wait_until(lock, deadline, [this] () {
+			for (const SlowSensor &s : slow_)
+				if (s.in_flight && !s.done)
+					return false;
+			return true;
+		} );
+
+		for (SlowSensor &s : slow_) {
+			if (s.in_flight && s.done) {
+				// Might be the result of a late read from a previous loop, but it's still the latest
+				s.in_flight = false;
+				s.action = SlowSensor::FETCHED;
+			}
+			else if (!due_[s.index])
+				s.action = SlowSensor::NONE;
+			else if (s.in_flight)
+				s.action = SlowSensor::LATE;
+			else
+				s.action = SlowSensor::READ;
+		}
+	}
+
+	for (SlowSensor &s : slow_) {
+		if (s.action == SlowSensor::FETCHED)
+			s.driver->read_fetched_temps();
+		else if (s.action == SlowSensor::LATE)
+			s.driver->skip_late_temps();
+		else if (s.action == SlowSensor::READ)
+			s.driver->read_temps();
+	}
+}
+
+
+void SensorSampler::work_()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		work_cond_.wait(lock, [this] () { return stop_ || !queue_.empty(); });
+		if (stop_)
+			return;
+
+		SlowSensor *s = queue_.front();
+		queue_.pop_front();
+
+		lock.unlock();
+		s->driver->fetch_temps();
+		lock.lock();
+
+		s->done = true;
+		done_cond_.notify_all();
+	}
+}
+
+
+#ifdef USE_IO_URING
+void SensorSampler::read_fast_temps_batched_()
+{
+	bool ring_broken = false;
+
+	auto complete = [&] (unsigned int tag, int res) {
+		SensorDriver *sensor = batched_[tag];
+		batched_[tag] = nullptr;
+		if (likely(res >= 0))
+			sensor->read_temps(&buffers_[tag * batch_buf_size], size_t(res));
+		else {
+			// Kernels older than 5.6 don't know IORING_OP_READ
+			if (res == -EINVAL || res == -EOPNOTSUPP)
+				ring_broken = true;
+			// Let the driver retry synchronously, which also takes care of re-opening and error handling
+			sensor->read_temps();
+		}
+	};
+
+	auto submit = [&] () {
+		try {
+			ring_->submit_and_wait(complete);
+		} catch (SystemError &e) {
+			log(TF_WRN) << e.what() << ". Falling back to synchronous sensor reads." << flush;
+			ring_.reset();
+			for (SensorDriver *sensor : batched_)
+				if (sensor)
+					sensor->read_temps();
+		}
+	};
+
+	batched_.clear();
+	for (size_t i = 0; i < sensors_.size(); ++i) {
+		const unique_ptr<SensorDriver> &sensor = sensors_[i];
+		if (!due_[i] || sensor->blocking())
+			continue;
+
+		int fd = ring_ && sensor->available() && sensor->initialized() ? sensor->batch_fd() : -1;
+		if (fd < 0) {
+			sensor->read_temps();
+			continue;
+		}
+
+		unsigned int tag = static_cast<unsigned int>(batched_.size());
+		batched_.push_back(sensor.get());
+		ring_->queue_read(fd, &buffers_[tag * batch_buf_size], batch_buf_size, tag);
+
+		if (ring_->queued() >= ring_->capacity())
+			submit();
+	}
+
+	if (ring_ && ring_->queued())
+		submit();
+
+	if (unlikely(ring_broken && ring_)) {
+		log(TF_DBG) << "io_uring doesn't support reads on this kernel. Falling back to synchronous sensor reads." << flush;
+		ring_.reset();
+	}
+}
+#endif // USE_IO_URING
+
+
+} // namespace thinkfan
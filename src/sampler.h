@@ -0,0 +1,92 @@
+#pragma once
+
+/********************************************************************
+ * sampler.h: Reading all configured sensors in one go
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "thinkfan.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+namespace thinkfan {
+
+
+#ifdef USE_IO_URING
+class IoUring;
+#endif
+
+
+/** @brief Reads the temperatures of all sensors in a config once per loop.
+ *  If thinkfan was built with USE_IO_URING and the kernel supports it, all sensors that expose a
+ *  @a SensorDriver::batch_fd() are read with a single io_uring submission. Everything else (and
+ *  everything, if io_uring is unavailable) is read synchronously via @a SensorDriver::read_temps().
+ *  Drivers that are @a SensorDriver::blocking() are read concurrently on worker threads. If one of them
+ *  doesn't finish within @a read_deadline, its temperatures are skipped for that loop. */
+class SensorSampler {
+public:
+	SensorSampler(const vector<unique_ptr<SensorDriver>> &sensors);
+	~SensorSampler();
+
+	/// @brief Read all sensors
+	void read_temps();
+
+	/// @brief Read only the sensors whose entry in @a due is true (same order as the config's sensors).
+	void read_temps(const vector<bool> &due);
+
+private:
+	struct SlowSensor {
+		SensorDriver *driver;
+		size_t index;
+		bool in_flight;
+		bool done;
+		enum { NONE, READ, LATE, FETCHED } action;
+	};
+
+	void read_due_temps_();
+	void read_fast_temps_();
+	void dispatch_slow_();
+	void collect_slow_(std::chrono::steady_clock::time_point deadline);
+	void work_();
+
+	const vector<unique_ptr<SensorDriver>> &sensors_;
+	vector<bool> due_;
+
+	vector<SlowSensor> slow_;
+	vector<std::thread> workers_;
+	std::deque<SlowSensor *> queue_;
+	std::mutex mutex_;
+	std::condition_variable work_cond_;
+	std::condition_variable done_cond_;
+	bool stop_;
+
+#ifdef USE_IO_URING
+	void read_fast_temps_batched_();
+
+	unique_ptr<IoUring> ring_;
+	vector<char> buffers_;
+	vector<SensorDriver *> batched_;
+#endif
+};
+
+
+} // namespace thinkfan
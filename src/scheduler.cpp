@@ -0,0 +1,101 @@
+/********************************************************************
+ * scheduler.cpp: Deadline-ordered wakeups for the main loop
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "scheduler.h"
+#include "error.h"
+
+namespace thinkfan {
+
+
+void Scheduler::schedule(unsigned int id, clock::time_point when)
+{
+	if (id >= deadlines_.size())
+		deadlines_.resize(id + 1, clock::time_point::max());
+	deadlines_[id] = when;
+	heap_.push({ when, id });
+}
+
+
+void Scheduler::advance(unsigned int id, clock::time_point when)
+{
+	if (id >= deadlines_.size() || when < deadlines_[id])
+		schedule(id, when);
+}
+
+
+void Scheduler::reschedule(const Entry &entry, clock::time_point now, clock::duration period)
+{
+	clock::time_point when = entry.when + period;
+	if (when <= now)
+		when = now + period;
+	schedule(entry.id, when);
+}
+
+
+void Scheduler::prune_()
+{
+	while (!heap_.empty() && heap_.top().when != deadlines_[heap_.top().id])
+		heap_.pop();
+}
+
+
+Scheduler::clock::time_point Scheduler::next()
+{
+	prune_();
+	if (heap_.empty())
+		throw Bug("Scheduler: nothing scheduled");
+	return heap_.top().when;
+}
+
+
+void Scheduler::pop_due(clock::time_point now, vector<Entry> &due)
+{
+	due.clear();
+	prune_();
+	while (!heap_.empty() && heap_.top().when <= now) {
+		due.push_back(heap_.top());
+		deadlines_[heap_.top().id] = clock::time_point::max();
+		heap_.pop();
+		prune_();
+	}
+}
+
+
+bool Scheduler::empty()
+{
+	prune_();
+	return heap_.empty();
+}
+
+
+milliseconds adapt_sleeptime(milliseconds current, bool fast_rise, bool tick, milliseconds floor, milliseconds ceiling)
+{
+	if (fast_rise)
+		return std::min(current, floor);
+	if (tick && current < ceiling)
+		// Geometric growth: A few quick steps after a short transient, but no jump straight back
+		// to the full sleeptime while things may still be heating up.
+		return std::min(current + std::max(current / 2, milliseconds(1)), ceiling);
+	return std::min(current, ceiling);
+}
+
+
+} // namespace thinkfan
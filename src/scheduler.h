@@ -0,0 +1,78 @@
+#pragma once
+
+/********************************************************************
+ * scheduler.h: Deadline-ordered wakeups for the main loop
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "thinkfan.h"
+
+#include <queue>
+
+namespace thinkfan {
+
+
+/** @brief A min-heap of (deadline, id) pairs. The main loop sleeps until the earliest deadline,
+ *  then handles everything that's due and schedules it again. */
+class Scheduler {
+public:
+	using clock = std::chrono::steady_clock;
+
+	struct Entry {
+		clock::time_point when;
+		unsigned int id;
+
+		bool operator > (const Entry &other) const
+		{ return when > other.when; }
+	};
+
+	/// @brief Schedule @a id at @a when. If @a id is already scheduled, its previous deadline is dropped.
+	void schedule(unsigned int id, clock::time_point when);
+
+	/// @brief Like schedule(), but never postpones @a id if it's already scheduled before @a when.
+	void advance(unsigned int id, clock::time_point when);
+
+	/** @brief Schedule @a entry again, @a period after its previous deadline. If that's already
+	 *  in the past (e.g. because we were suspended), start over from @a now. */
+	void reschedule(const Entry &entry, clock::time_point now, clock::duration period);
+
+	/// @return The earliest deadline. Must not be called when nothing is scheduled.
+	clock::time_point next();
+
+	/// @brief Remove all entries that are due at @a now and put them into @a due (which is cleared first).
+	void pop_due(clock::time_point now, vector<Entry> &due);
+
+	bool empty();
+
+private:
+	/// @brief Drop entries from the top of the heap that have been superseded by a later schedule().
+	void prune_();
+
+	std::priority_queue<Entry, vector<Entry>, std::greater<Entry>> heap_;
+	vector<clock::time_point> deadlines_;
+};
+
+
+/** @brief The control period after a wakeup: If a temperature rose quickly (@a fast_rise), drop
+ *  to @a floor right away. Otherwise, grow by half the current period on each control tick
+ *  (@a tick), until @a ceiling is reached. */
+milliseconds adapt_sleeptime(milliseconds current, bool fast_rise, bool tick, milliseconds floor, milliseconds ceiling);
+
+
+} // namespace thinkfan
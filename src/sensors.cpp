@@ -27,10 +27,10 @@
 #include <cstring>
 #include <typeinfo>
 #include <cmath>
-
-#ifdef USE_NVML
-#include <dlfcn.h>
-#endif
+#include <cerrno>
+#include <algorithm>
+#include <utility>
+#include <dirent.h>
 
 namespace thinkfan {
 
@@ -84,12 +84,24 @@ void SensorDriver::set_num_temps(unsigned int n)
 
 bool SensorDriver::operator == (const SensorDriver &other) const
 {
-	return typeid(*this) == typeid(other)
-			&& this->correction_ == other.correction_
-	&& this->path() == other.path();
+	// The correction is padded with zeros once the number of temperatures is known
+	auto correction = [] (const vector<int> &c, size_t i) { return i < c.size() ? c[i] : 0; };
+	for (size_t i = 0; i < std::max(correction_.size(), other.correction_.size()); ++i)
+		if (correction(correction_, i) != correction(other.correction_, i))
+			return false;
+
+	return Driver::operator == (other)
+			&& this->interval_ == other.interval_;
 }
 
 
+const opt<milliseconds> &SensorDriver::interval() const
+{ return interval_; }
+
+void SensorDriver::set_interval(milliseconds interval)
+{ interval_ = interval; }
+
+
 void SensorDriver::read_temps()
 {
 	temp_state_.restart();
@@ -100,6 +112,86 @@ void SensorDriver::init_temp_state_ref(TemperatureState::Ref &&ref)
 { temp_state_ = std::move(ref); }
 
 
+int SensorDriver::batch_fd() const
+{ return -1; }
+
+
+void SensorDriver::read_temps(const char *buf, size_t len)
+{
+	temp_state_.restart();
+	robust_op(
+		[&] () { parse_temps_(buf, len); },
+		std::bind(&SensorDriver::skip_io_error, this, std::placeholders::_1)
+	);
+}
+
+
+void SensorDriver::parse_temps_(const char *, size_t)
+{ throw Bug(type_name() + ": batched reads are not supported"); }
+
+
+bool SensorDriver::blocking() const
+{ return false; }
+
+
+void SensorDriver::fetch_temps()
+{
+	try {
+		fetch_temps_();
+		fetch_error_ = nullptr;
+	} catch (...) {
+		fetch_error_ = std::current_exception();
+	}
+}
+
+
+void SensorDriver::read_fetched_temps()
+{
+	temp_state_.restart();
+	robust_op(
+		[&] () {
+			if (fetch_error_)
+				std::rethrow_exception(std::exchange(fetch_error_, nullptr));
+			add_fetched_temps_();
+		},
+		std::bind(&SensorDriver::skip_io_error, this, std::placeholders::_1)
+	);
+}
+
+
+void SensorDriver::skip_late_temps()
+{
+	temp_state_.restart();
+	const IOerror timeout(MSG_T_GET(path()), ETIMEDOUT);
+	// Counts towards max_errors just like any other failed read
+	robust_op(
+		[&] () { throw timeout; },
+		std::bind(&SensorDriver::skip_io_error, this, std::placeholders::_1)
+	);
+}
+
+
+bool SensorDriver::set_alarm_window(const int *, const int *)
+{ return false; }
+
+void SensorDriver::alarm_fds(vector<pollfd> &) const
+{}
+
+bool SensorDriver::ack_alarm(int)
+{ return false; }
+
+
+void SensorDriver::fetch_temps_()
+{ throw Bug(type_name() + ": asynchronous reads are not supported"); }
+
+
+void SensorDriver::add_fetched_temps_()
+{
+	for (int t : fetched_temps_)
+		temp_state_.add_temp(t);
+}
+
+
 void SensorDriver::check_correction_length()
 {
 	if (correction_.size() > num_temps())
@@ -109,6 +201,11 @@ void SensorDriver::check_correction_length()
 }
 
 
+// Only an optional sensor may stay missing. Everything else must count its errors towards max_errors.
+bool SensorDriver::backs_off() const
+{ return optional(); }
+
+
 void SensorDriver::skip_io_error(const ExpectedError &e)
 {
 	if (this->optional()) {
@@ -154,29 +251,396 @@ HwmonSensorDriver::HwmonSensorDriver(
 )
 : SensorDriver(optional, correction ? vector<int>{*correction} : vector<int>{}, max_errors)
 , hwmon_interface_(hwmon_interface)
+, client_idx_(hwmon_interface->add_client())
+, use_alarms_(false)
+, alarms_ok_(false)
 {}
 
+HwmonSensorDriver::~HwmonSensorDriver() noexcept(false)
+{
+	restore_limit_(max_);
+	restore_limit_(min_);
+}
+
 void HwmonSensorDriver::init()
 {
-	SensorDriver::init();
+	try {
+		file_.open(path());
+	} catch (IOerror &e) {
+		throw IOerror(MSG_SENSOR_INIT(path()), e.code());
+	}
+	char buf[32];
+	parse_value_(buf, file_.read(buf, sizeof(buf)));
 	set_num_temps(1);
+
+	if (use_alarms_)
+		init_alarms_();
+}
+
+void HwmonSensorDriver::set_alarm(bool alarm)
+{ use_alarms_ = alarm; }
+
+
+void HwmonSensorDriver::init_alarms_()
+{
+	static const string input_suffix("_input");
+	const string &input = path();
+	if (input.length() <= input_suffix.length()
+			|| input.compare(input.length() - input_suffix.length(), input_suffix.length(), input_suffix))
+		throw ConfigError(MSG_SENSOR_NO_ALARM(input));
+	const string base = input.substr(0, input.length() - input_suffix.length());
+
+	alarms_ok_ = false;
+	alarm_file_.close();
+	try {
+		alarm_file_.open(base + "_alarm");
+	} catch (IOerror &) {
+	}
+	init_limit_(max_, base + "_max", base + "_max_alarm");
+	init_limit_(min_, base + "_min", base + "_min_alarm");
+
+	if (!max_.file.is_open() || !(max_.alarm.is_open() || alarm_file_.is_open()))
+		throw ConfigError(MSG_SENSOR_NO_ALARM(input));
+
+	// sysfs_notify() only wakes up poll() for attributes that have been read before
+	char buf[16];
+	for (PersistentFile *f : { &max_.alarm, &min_.alarm, &alarm_file_ })
+		if (f->is_open())
+			f->read(buf, sizeof(buf));
+
+	alarms_ok_ = true;
+	log(TF_DBG) << "Using alarms of " << input << "." << flush;
+}
+
+
+void HwmonSensorDriver::init_limit_(AlarmLimit &limit, const string &limit_path, const string &alarm_path)
+{
+	limit.file.close();
+	limit.alarm.close();
+	limit.current.reset();
+
+	try {
+		limit.file.open(limit_path);
+	} catch (IOerror &) {
+		// Limit doesn't exist or isn't writable
+		return;
+	}
+	try {
+		limit.alarm.open(alarm_path);
+	} catch (IOerror &) {
+	}
+
+	char buf[16];
+	int value;
+	size_t len = limit.file.read(buf, sizeof(buf));
+	const char *p = buf;
+	if (!parse_int(p, buf + len, value))
+		throw IOerror(MSG_SENSOR_INIT(limit_path), EINVAL);
+
+	// Keep the very first value across re-initializations, that's what we have to restore.
+	if (!limit.initial)
+		limit.initial = value;
+	limit.current = value;
+}
+
+
+void HwmonSensorDriver::write_limit_(AlarmLimit &limit, int millidegrees)
+{
+	if (limit.current == millidegrees)
+		return;
+	const string value = std::to_string(millidegrees);
+	limit.file.write(value.data(), value.length());
+	limit.current = millidegrees;
+}
+
+
+void HwmonSensorDriver::restore_limit_(AlarmLimit &limit)
+{
+	if (!limit.initial || !limit.file.is_open())
+		return;
+	try {
+		write_limit_(limit, *limit.initial);
+	} catch (IOerror &e) {
+		log(TF_ERR) << e.what() << flush;
+	}
+}
+
+
+bool HwmonSensorDriver::set_alarm_window(const int *lower, const int *upper)
+{
+	if (!alarms_ok_ || !available() || !initialized())
+		return false;
+
+	auto to_millidegrees = [&] (long long limit) {
+		return int(std::clamp<long long>(
+			(limit - correction_[0]) * 1000,
+			numeric_limits<int>::min(),
+			numeric_limits<int>::max()
+		));
+	};
+	const bool have_min = min_.file.is_open() && (min_.alarm.is_open() || alarm_file_.is_open());
+
+	try {
+		// Chips raise the max alarm when temp > max. Setting it 1°C below the limit makes
+		// it go off as soon as we reach the limit.
+		if (*upper == numeric_limits<int>::max())
+			restore_limit_(max_);
+		else
+			write_limit_(max_, to_millidegrees(*upper - 1LL));
+
+		if (*lower == numeric_limits<int>::min()) {
+			if (have_min)
+				restore_limit_(min_);
+		}
+		else if (have_min)
+			write_limit_(min_, to_millidegrees(*lower));
+		else
+			return false;
+	} catch (IOerror &e) {
+		log(TF_WRN) << MSG_SENSOR_ALARM_ERR(path()) << e.what() << flush;
+		restore_limit_(max_);
+		restore_limit_(min_);
+		alarms_ok_ = false;
+		return false;
+	}
+
+	return true;
+}
+
+
+void HwmonSensorDriver::alarm_fds(vector<pollfd> &fds) const
+{
+	if (!alarms_ok_)
+		return;
+	for (const PersistentFile *f : { &max_.alarm, &min_.alarm, &alarm_file_ })
+		if (f->is_open())
+			fds.push_back({ f->fd(), POLLPRI, 0 });
+}
+
+
+bool HwmonSensorDriver::ack_alarm(int fd)
+{
+	char buf[16];
+	for (PersistentFile *f : { &max_.alarm, &min_.alarm, &alarm_file_ }) {
+		if (f->is_open() && f->fd() == fd) {
+			// Read the attribute so sysfs signals the next change again
+			try {
+				f->read(buf, sizeof(buf));
+			} catch (IOerror &e) {
+				log(TF_DBG) << e.what() << flush;
+			}
+			return true;
+		}
+	}
+	return false;
 }
 
 void HwmonSensorDriver::read_temps_()
+{
+	// temp*_input contains a single integer in millidegrees, e.g. "45000\n"
+	char buf[32];
+	size_t len;
+	try {
+		len = file_.read(buf, sizeof(buf));
+	} catch (IOerror &e) {
+		throw IOerror(MSG_T_GET(path()), e.code());
+	}
+	parse_temps_(buf, len);
+}
+
+void HwmonSensorDriver::parse_temps_(const char *buf, size_t len)
 {
 	temp_state_.add_temp(
-		readstream(path()) / 1000 + correction_[0]
+		parse_value_(buf, len) / 1000 + correction_[0]
 	);
 }
 
+int HwmonSensorDriver::parse_value_(const char *buf, size_t len)
+{
+	int rv;
+	if (unlikely(!parse_int(buf, buf + len, rv)))
+		throw IOerror(MSG_T_GET(path()), EINVAL);
+	return rv;
+}
+
+int HwmonSensorDriver::batch_fd() const
+{ return file_.fd(); }
 
 
 string HwmonSensorDriver::lookup()
-{ return hwmon_interface_->lookup(); }
+{ return hwmon_interface_->lookup(client_idx_); }
 
 string HwmonSensorDriver::type_name() const
 { return "hwmon sensor driver"; }
 
+string HwmonSensorDriver::source() const
+{ return hwmon_interface_->source() + "\n" + std::to_string(client_idx_) + (use_alarms_ ? "\nalarm" : ""); }
+
+
+/*----------------------------------------------------------------------------
+| ThermalZoneSensorDriver: Reads the temp file of a thermal zone from the    |
+| kernel's thermal framework, typically /sys/class/thermal/thermal_zone*.    |
+----------------------------------------------------------------------------*/
+
+ThermalZoneSensorDriver::ThermalZoneSensorDriver(
+	const string &zone,
+	bool optional,
+	opt<int> correction,
+	opt<unsigned int> max_errors
+)
+: SensorDriver(optional, correction ? vector<int>{*correction} : vector<int>{}, max_errors)
+, zone_(zone)
+, use_netlink_(false)
+{ set_num_temps(1); }
+
+
+ThermalZoneSensorDriver::~ThermalZoneSensorDriver() noexcept(false)
+{
+	if (netlink_ && zone_id_)
+		netlink_->remove_zone(*zone_id_);
+}
+
+
+void ThermalZoneSensorDriver::set_netlink(bool netlink)
+{ use_netlink_ = netlink; }
+
+
+string ThermalZoneSensorDriver::lookup()
+{
+	if (zone_.length() && zone_[0] == '/')
+		return zone_ + "/temp";
+
+	vector<string> found;
+	struct dirent **entries;
+	int nentries = ::scandir(DEFAULT_THERMAL_PATH, &entries, nullptr, alphasort);
+	if (nentries < 0)
+		throw DriverInitError(string(DEFAULT_THERMAL_PATH ": ") + strerror(errno));
+
+	for (int i = 0; i < nentries; i++) {
+		const string dir = string(DEFAULT_THERMAL_PATH "/") + entries[i]->d_name;
+		if (!strncmp("thermal_zone", entries[i]->d_name, 12)) {
+			ifstream f(dir + "/type");
+			string type;
+			if (f.is_open() && (f >> type) && type == zone_)
+				found.push_back(dir);
+		}
+		free(entries[i]);
+	}
+	free(entries);
+
+	if (found.size() != 1) {
+		string msg(DEFAULT_THERMAL_PATH ": ");
+		if (found.empty())
+			msg += "Could not find a thermal zone with this type: " + zone_;
+		else {
+			msg += MSG_MULTIPLE_THERMAL_ZONES_FOUND(zone_);
+			for (const string &path : found)
+				msg += " " + path;
+		}
+		throw DriverInitError(msg);
+	}
+
+	return found.front() + "/temp";
+}
+
+
+void ThermalZoneSensorDriver::init()
+{
+	try {
+		file_.open(path());
+	} catch (IOerror &e) {
+		throw IOerror(MSG_SENSOR_INIT(path()), e.code());
+	}
+	char buf[32];
+	parse_value_(buf, file_.read(buf, sizeof(buf)));
+
+	if (!use_netlink_)
+		return;
+
+	// The zone ID in netlink events is the number in the thermal_zone* directory name
+	opt<int> zone_id;
+	const string::size_type dir_start = path().rfind("thermal_zone");
+	if (dir_start != string::npos) {
+		const char *p = path().c_str() + dir_start + 12;
+		int id;
+		if (parse_int(p, path().c_str() + path().length(), id))
+			zone_id = id;
+	}
+	if (!zone_id) {
+		log(TF_WRN) << "Can't use thermal netlink events for " << path() << ": Unknown zone ID." << flush;
+		return;
+	}
+
+	try {
+		if (!netlink_)
+			netlink_ = ThermalNetlink::instance();
+		if (zone_id_)
+			netlink_->remove_zone(*zone_id_);
+		netlink_->add_zone(*zone_id);
+		zone_id_ = zone_id;
+	} catch (SystemError &e) {
+		log(TF_WRN) << e.what() << " Polling " << path() << " instead." << flush;
+		use_netlink_ = false;
+	}
+}
+
+
+void ThermalZoneSensorDriver::read_temps_()
+{
+	char buf[32];
+	size_t len;
+	try {
+		len = file_.read(buf, sizeof(buf));
+	} catch (IOerror &e) {
+		throw IOerror(MSG_T_GET(path()), e.code());
+	}
+	parse_temps_(buf, len);
+}
+
+
+void ThermalZoneSensorDriver::parse_temps_(const char *buf, size_t len)
+{
+	temp_state_.add_temp(
+		parse_value_(buf, len) / 1000 + correction_[0]
+	);
+}
+
+
+int ThermalZoneSensorDriver::parse_value_(const char *buf, size_t len)
+{
+	int rv;
+	if (unlikely(!parse_int(buf, buf + len, rv)))
+		throw IOerror(MSG_T_GET(path()), EINVAL);
+	return rv;
+}
+
+
+int ThermalZoneSensorDriver::batch_fd() const
+{ return file_.fd(); }
+
+
+void ThermalZoneSensorDriver::alarm_fds(vector<pollfd> &fds) const
+{
+	if (!netlink_ || !zone_id_)
+		return;
+	for (const pollfd &pfd : fds)
+		if (pfd.fd == netlink_->fd())
+			return;
+	fds.push_back({ netlink_->fd(), POLLIN, 0 });
+}
+
+
+bool ThermalZoneSensorDriver::ack_alarm(int fd)
+{ return netlink_ && fd == netlink_->fd() && netlink_->handle_events(); }
+
+
+string ThermalZoneSensorDriver::type_name() const
+{ return "thermal zone sensor driver"; }
+
+string ThermalZoneSensorDriver::source() const
+{ return zone_ + (use_netlink_ ? "\nnetlink" : ""); }
+
+
 
 /*----------------------------------------------------------------------------
 | TpSensorDriver: A driver for sensors provided by thinkpad_acpi, typically  |
@@ -203,32 +667,29 @@ TpSensorDriver::TpSensorDriver(
 
 void TpSensorDriver::init()
 {
-	int tmp;
-	unsigned int count = 0;
-
-	string skip;
-	skip.resize(skip_prefix_.size());
-
-	std::ifstream f(path());
-	if (!(f.is_open() && f.good()))
-		throw IOerror(MSG_SENSOR_INIT(path()), errno);
-
-	if (!f.get(&*skip.begin(), static_cast<std::streamsize>(skip_prefix_.size() + 1)))
-		throw IOerror(MSG_SENSOR_INIT(path()), errno);
+	char buf[max_data_size];
+	size_t len;
+
+	try {
+		file_.open(path());
+		len = file_.read(buf, sizeof(buf));
+	} catch (IOerror &e) {
+		throw IOerror(MSG_SENSOR_INIT(path()), e.code());
+	}
 
-	if (skip == skip_prefix_)
-		skip_bytes_ = f.tellg();
-	else
+	if (len < skip_prefix_.size() || skip_prefix_.compare(0, string::npos, buf, skip_prefix_.size()))
 		throw SystemError(path() + ": Unknown file format.");
+	if (len >= sizeof(buf))
+		throw SystemError(path() + ": Unexpectedly long content.");
+	skip_bytes_ = skip_prefix_.size();
 
-	while (!(f.eof() || f.fail())) {
-		f >> tmp;
-		if (f.bad())
-			throw IOerror(MSG_T_GET(path()), errno);
-		if (!f.fail())
-			++count;
-	}
+	unsigned int count = 0;
+	int tmp;
+	const char *p = buf + skip_bytes_;
+	while (parse_int(p, buf + len, tmp))
+		++count;
 
+	used_indices_.clear();
 	if (temp_indices_) {
 		if (temp_indices_->size() > count)
 			throw ConfigError(
@@ -237,13 +698,21 @@ void TpSensorDriver::init()
 				+ ", but there are only " + std::to_string(count) + "."
 			);
 
-
-		in_use_ = vector<bool>(count, false);
-		for (unsigned int i : *temp_indices_)
-			in_use_[i] = true;
+		for (unsigned int i : *temp_indices_) {
+			if (i >= count)
+				throw ConfigError(
+					"Temperature index " + std::to_string(i) + " is out of range: "
+					+ path() + " has only " + std::to_string(count) + " temperatures."
+				);
+			used_indices_.push_back(i);
+		}
+		// Temperatures are stored in the order they appear in the file
+		std::sort(used_indices_.begin(), used_indices_.end());
+		used_indices_.erase(std::unique(used_indices_.begin(), used_indices_.end()), used_indices_.end());
 	}
 	else {
-		in_use_ = vector<bool>(count, true);
+		for (unsigned int i = 0; i < count; ++i)
+			used_indices_.push_back(i);
 		set_num_temps(count);
 	}
 }
@@ -251,27 +720,42 @@ void TpSensorDriver::init()
 
 void TpSensorDriver::read_temps_()
 {
-	std::ifstream f(path());
-	if (!(f.is_open() && f.good()))
-		throw IOerror(MSG_T_GET(path()), errno);
+	char buf[max_data_size];
+	size_t len;
+	try {
+		len = file_.read(buf, sizeof(buf));
+	} catch (IOerror &e) {
+		throw IOerror(MSG_T_GET(path()), e.code());
+	}
+	parse_temps_(buf, len);
+}
 
-	f.seekg(skip_bytes_);
-	if (f.fail())
-		throw IOerror(MSG_T_GET(path()), errno);
 
+void TpSensorDriver::parse_temps_(const char *buf, size_t len)
+{
+	if (unlikely(len < skip_bytes_))
+		throw IOerror(MSG_T_GET(path()), EINVAL);
+
+	const char *p = buf + skip_bytes_;
+	const char *end = buf + len;
 	unsigned int tidx = 0;
-	unsigned int cidx = 0;
 	int tmp;
-	while (!(f.eof() || f.fail())) {
-		f >> tmp;
-		if (f.bad())
-			throw IOerror(MSG_T_GET(path()), errno);
-		if (!f.fail() && in_use_[tidx++])
-			temp_state_.add_temp(tmp + correction_[cidx++]);
+
+	for (unsigned int cidx = 0; cidx < used_indices_.size(); ++tidx) {
+		if (unlikely(!parse_int(p, end, tmp)))
+			throw IOerror(MSG_T_GET(path()), EINVAL);
+		if (tidx == used_indices_[cidx]) {
+			temp_state_.add_temp(tmp + correction_[cidx]);
+			++cidx;
+		}
 	}
 }
 
 
+int TpSensorDriver::batch_fd() const
+{ return file_.fd(); }
+
+
 string TpSensorDriver::lookup()
 {
 	std::ifstream f(conf_path_);
@@ -284,6 +768,15 @@ string TpSensorDriver::lookup()
 string TpSensorDriver::type_name() const
 { return "tpacpi sensor driver"; }
 
+string TpSensorDriver::source() const
+{
+	string rv = conf_path_;
+	if (temp_indices_)
+		for (unsigned int idx : *temp_indices_)
+			rv += "\n" + std::to_string(idx);
+	return rv;
+}
+
 
 #ifdef USE_ATASMART
 /*----------------------------------------------------------------------------
@@ -318,6 +811,14 @@ AtasmartSensorDriver::~AtasmartSensorDriver()
 
 void AtasmartSensorDriver::read_temps_()
 {
+	fetch_temps_();
+	add_fetched_temps_();
+}
+
+
+void AtasmartSensorDriver::fetch_temps_()
+{
+	fetched_temps_.clear();
 	SkBool disk_sleeping = false;
 
 	if (unlikely(dnd_disk && (sk_disk_check_sleep_mode(disk_, &disk_sleeping) < 0))) {
@@ -326,7 +827,7 @@ void AtasmartSensorDriver::read_temps_()
 	}
 
 	if (unlikely(disk_sleeping)) {
-		temp_state_.add_temp(0);
+		fetched_temps_.push_back(0);
 	}
 	else {
 		uint64_t mKelvin;
@@ -348,16 +849,22 @@ void AtasmartSensorDriver::read_temps_()
 			throw SystemError(MSG_T_GET(path()) + std::to_string(tmp) + " isn't a valid temperature.");
 		}
 
-		temp_state_.add_temp(int(tmp) + correction_[0]);
+		fetched_temps_.push_back(int(tmp) + correction_[0]);
 	}
 }
 
+bool AtasmartSensorDriver::blocking() const
+{ return true; }
+
 string AtasmartSensorDriver::lookup()
 { return device_path_; }
 
 string AtasmartSensorDriver::type_name() const
 { return "atasmart sensor driver"; }
 
+string AtasmartSensorDriver::source() const
+{ return device_path_; }
+
 #endif /* USE_ATASMART */
 
 
@@ -370,75 +877,41 @@ string AtasmartSensorDriver::type_name() const
 NvmlSensorDriver::NvmlSensorDriver(string bus_id, bool optional, opt<vector<int>> correction, opt<unsigned int> max_errors)
 : SensorDriver(optional, correction, max_errors),
   bus_id_(bus_id),
-  dl_nvmlInit_v2(nullptr),
-  dl_nvmlDeviceGetHandleByPciBusId_v2(nullptr),
-  dl_nvmlDeviceGetName(nullptr),
-  dl_nvmlDeviceGetTemperature(nullptr),
-  dl_nvmlShutdown(nullptr)
-{
-	if (!(nvml_so_handle_ = dlopen("libnvidia-ml.so.1", RTLD_LAZY))) {
-		string msg = strerror(errno);
-		throw SystemError("Failed to load libnvidia-ml.so.1: " + msg);
-	}
-
-	/* Apparently GCC doesn't want to cast to function pointers, so we have to do
-	 * this kind of weird stuff.
-	 * See http://stackoverflow.com/questions/1096341/function-pointers-casting-in-c
-	 */
-	*reinterpret_cast<void **>(&dl_nvmlInit_v2) = dlsym(nvml_so_handle_, "nvmlInit_v2");
-	*reinterpret_cast<void **>(&dl_nvmlDeviceGetHandleByPciBusId_v2) = dlsym(
-			nvml_so_handle_, "nvmlDeviceGetHandleByPciBusId_v2");
-	*reinterpret_cast<void **>(&dl_nvmlDeviceGetName) = dlsym(nvml_so_handle_, "nvmlDeviceGetName");
-	*reinterpret_cast<void **>(&dl_nvmlDeviceGetTemperature) = dlsym(nvml_so_handle_, "nvmlDeviceGetTemperature");
-	*reinterpret_cast<void **>(&dl_nvmlShutdown) = dlsym(nvml_so_handle_, "nvmlShutdown");
-
-	if (!(dl_nvmlDeviceGetHandleByPciBusId_v2 && dl_nvmlDeviceGetName &&
-			dl_nvmlDeviceGetTemperature && dl_nvmlInit_v2 && dl_nvmlShutdown))
-		throw SystemError("Incompatible NVML driver.");
-	set_num_temps(1);
-}
+  nvml_iface_(NvmlInterface::instance())
+{ set_num_temps(1); }
 
 
 void NvmlSensorDriver::init()
 {
-	nvmlReturn_t ret;
-	string name, brand;
-	name.resize(256);
-	brand.resize(256);
-
-	if ((ret = dl_nvmlInit_v2()))
-		throw SystemError("Failed to initialize NVML driver. Error code (cf. nvml.h): " + std::to_string(ret));
-	if ((ret = dl_nvmlDeviceGetHandleByPciBusId_v2(path().c_str(), &device_)))
-		throw SystemError("Failed to open PCI device " + path() + ". Error code (cf. nvml.h): " + std::to_string(ret));
-	dl_nvmlDeviceGetName(device_, &*name.begin(), 255);
+	string name = nvml_iface_->lookup_device(path());
 	log(TF_DBG) << "Initialized NVML sensor on " << name << " at PCI " << path() << "." << flush;
 }
 
 
-NvmlSensorDriver::~NvmlSensorDriver() noexcept(false)
+void NvmlSensorDriver::read_temps_()
 {
-	nvmlReturn_t ret;
-	if ((ret = dl_nvmlShutdown()))
-		log(TF_ERR) << "Failed to shutdown NVML driver. Error code (cf. nvml.h): " << std::to_string(ret);
-	dlclose(nvml_so_handle_);
+	fetch_temps_();
+	add_fetched_temps_();
 }
 
-
-void NvmlSensorDriver::read_temps_()
+void NvmlSensorDriver::fetch_temps_()
 {
-	nvmlReturn_t ret;
-	unsigned int tmp;
-	if ((ret = dl_nvmlDeviceGetTemperature(device_, NVML_TEMPERATURE_GPU, &tmp)))
-		throw SystemError(MSG_T_GET(path()) + "Error code (cf. nvml.h): " + std::to_string(ret));
-	temp_state_.add_temp(int(tmp));
+	fetched_temps_.clear();
+	fetched_temps_.push_back(int(nvml_iface_->get_temp(path())));
 }
 
+bool NvmlSensorDriver::blocking() const
+{ return true; }
+
 string NvmlSensorDriver::lookup()
 { return bus_id_; }
 
 string NvmlSensorDriver::type_name() const
 { return "NVML sensor driver"; }
 
+string NvmlSensorDriver::source() const
+{ return bus_id_; }
+
 #endif /* USE_NVML */
 
 
@@ -466,7 +939,10 @@ LMSensorsDriver::LMSensorsDriver(
 
 
 LMSensorsDriver::~LMSensorsDriver()
-{}
+{
+	if (libsensors_iface_)
+		libsensors_iface_->remove_client(this);
+}
 
 const string &LMSensorsDriver::chip_name() const
 { return chip_name_; }
@@ -494,20 +970,27 @@ string LMSensorsDriver::lookup()
 
 	// If a sensor is not found, uninit() is called on ALL OTHER LMSensorsDrivers
 	// instances and an exception is thrown.
-	return libsensors_iface_->lookup_client_features(this);
+	return libsensors_iface_->lookup_client_features(this, features_);
 }
 
 
 string LMSensorsDriver::type_name() const
 { return "libsensors sensor driver"; }
 
+string LMSensorsDriver::source() const
+{
+	string rv = chip_name_;
+	for (const string &feature : feature_names_)
+		rv += "\n" + feature;
+	return rv;
+}
+
 
 void LMSensorsDriver::read_temps_()
 {
-	size_t index = 0;
-	for (double real_value : libsensors_iface_->get_temps(this))
+	for (size_t index = 0; index < features_.features.size(); ++index)
 		temp_state_.add_temp(
-			int(real_value) + correction_[index++]
+			LibsensorsInterface::get_temp(features_, index, chip_name_) + correction_[index]
 		);
 }
 
@@ -27,18 +27,19 @@
 #include "driver.h"
 #include "hwmon.h"
 #include "libsensors.h"
+#include "nvml.h"
 #include "temperature_state.h"
+#include "persistent_file.h"
+#include "thermal_netlink.h"
 
 #ifdef USE_ATASMART
 #include <atasmart.h>
 #endif /* USE_ATASMART */
 
-#ifdef USE_NVML
-#include <nvidia/gdk/nvml.h>
-#endif /* USE_NVML */
-
 
 #include <optional>
+#include <exception>
+#include <poll.h>
 
 namespace thinkfan {
 
@@ -58,16 +59,70 @@ public:
 	void set_correction(const vector<int> &correction);
 	bool operator == (const SensorDriver &other) const;
 
+	/// @return How often this sensor should be read. If unset, it's read in every loop.
+	const opt<milliseconds> &interval() const;
+	void set_interval(milliseconds interval);
+
 	void read_temps();
 	void init_temp_state_ref(TemperatureState::Ref &&);
 
+	/** @return An fd that yields this driver's raw data when read at offset 0, or -1 if the driver
+	 *  can only be read through @a read_temps(). Only meaningful if @a available() and
+	 *  @a initialized() are both true. */
+	virtual int batch_fd() const;
+
+	/** @brief Update the temperature state from data that was read from @a batch_fd() by someone else
+	 *  (cf. @a SensorSampler). Errors are handled just like in @a read_temps(). */
+	void read_temps(const char *buf, size_t len);
+
+	/// @return true if reading this driver may block the control loop for a noticeable amount of time.
+	virtual bool blocking() const;
+
+	/** @brief The blocking half of @a read_temps(). Meant to be called on a worker thread, so it
+	 *  doesn't touch the temperature state and it doesn't log. Any error is kept until
+	 *  @a read_fetched_temps() is called. */
+	void fetch_temps();
+
+	/// @brief Put the temperatures obtained by @a fetch_temps() into the temperature state.
+	void read_fetched_temps();
+
+	/** @brief Give up on a @a fetch_temps() that didn't finish in time and keep the last temperatures.
+	 *  This is a read error (ETIMEDOUT), so it may throw once @a max_errors() is exceeded. */
+	void skip_late_temps();
+
+	/** @brief Have the hardware signal (cf. @a alarm_fds()) when one of this sensor's temperatures
+	 *  reaches @a upper or drops below @a lower. Both point to this sensor's first temperature and
+	 *  have one entry per temperature, in corrected °C. numeric_limits<int>::max() resp. min() means
+	 *  there's no limit in that direction.
+	 *  @return true if the hardware will signal every crossing, i.e. this sensor doesn't need to be polled. */
+	virtual bool set_alarm_window(const int *lower, const int *upper);
+
+	/** @brief Append the fds (with the events to poll for) that become ready when one of this sensor's
+	 *  alarms goes off. An fd that's already in @a fds must not be added again. */
+	virtual void alarm_fds(vector<pollfd> &fds) const;
+
+	/** @brief Consume the event on @a fd, which was added by @a alarm_fds() and is ready.
+	 *  @return true if the temperatures need to be looked at. */
+	virtual bool ack_alarm(int fd);
+
 protected:
 	virtual void init() override;
 	void set_num_temps(unsigned int n);
 	static inline int readstream(const string &path);
 	virtual void skip_io_error(const ExpectedError &e) override;
+	virtual bool backs_off() const override;
 	virtual void read_temps_() = 0;
 
+	/// Parse raw data read from @a batch_fd(). Must be implemented if @a batch_fd() can return an fd.
+	virtual void parse_temps_(const char *buf, size_t len);
+
+	/** @brief Read temperatures into @a fetched_temps_. Must be implemented if @a blocking() returns true.
+	 *  Must only touch driver-private state. */
+	virtual void fetch_temps_();
+	void add_fetched_temps_();
+
+	vector<int> fetched_temps_;
+
 	vector<int> correction_;
 	TemperatureState::Ref temp_state_;
 
@@ -75,6 +130,8 @@ protected:
 	 *  @param e The original error */
 private:
 	opt<unsigned int> num_temps_;
+	opt<milliseconds> interval_;
+	std::exception_ptr fetch_error_;
 	void check_correction_length();
 };
 
@@ -90,14 +147,87 @@ public:
 		opt<unsigned int> max_errors = nullopt
 	);
 
+	virtual ~HwmonSensorDriver() noexcept(false) override;
+
+	virtual int batch_fd() const override;
+
+	/// @brief Use the temp*_max/temp*_min alarms that belong to this temp*_input.
+	void set_alarm(bool alarm);
+	virtual bool set_alarm_window(const int *lower, const int *upper) override;
+	virtual void alarm_fds(vector<pollfd> &fds) const override;
+	virtual bool ack_alarm(int fd) override;
+
 protected:
 	virtual void init() override;
 	virtual void read_temps_() override;
 	virtual string lookup() override;
 	virtual string type_name() const override;
+	virtual string source() const override;
+	virtual void parse_temps_(const char *buf, size_t len) override;
 
 private:
+	/// A writable limit (temp*_max or temp*_min) and the value it had before thinkfan touched it
+	struct AlarmLimit {
+		AlarmLimit() : file(O_RDWR) {}
+		PersistentFile file;
+		PersistentFile alarm;
+		opt<int> initial;
+		opt<int> current;
+	};
+
+	int parse_value_(const char *buf, size_t len);
+	void init_alarms_();
+	void init_limit_(AlarmLimit &limit, const string &limit_path, const string &alarm_path);
+	void write_limit_(AlarmLimit &limit, int millidegrees);
+	void restore_limit_(AlarmLimit &limit);
+
 	shared_ptr<HwmonInterface<SensorDriver>> hwmon_interface_;
+	const unsigned int client_idx_;
+	PersistentFile file_;
+
+	bool use_alarms_;
+	bool alarms_ok_;
+	AlarmLimit max_;
+	AlarmLimit min_;
+	PersistentFile alarm_file_;
+};
+
+
+/** @brief A thermal zone from the kernel's thermal framework, identified by its type (or by the path
+ * of its thermal_zone* directory). Optionally wakes up the main loop when the kernel reports a
+ * trip point crossing via netlink. */
+class ThermalZoneSensorDriver : public SensorDriver {
+public:
+	ThermalZoneSensorDriver(
+		const string &zone,
+		bool optional,
+		opt<int> correction = nullopt,
+		opt<unsigned int> max_errors = nullopt
+	);
+	virtual ~ThermalZoneSensorDriver() noexcept(false) override;
+
+	void set_netlink(bool netlink);
+
+	virtual int batch_fd() const override;
+	virtual void alarm_fds(vector<pollfd> &fds) const override;
+	virtual bool ack_alarm(int fd) override;
+
+protected:
+	virtual void init() override;
+	virtual void read_temps_() override;
+	virtual string lookup() override;
+	virtual string type_name() const override;
+	virtual string source() const override;
+	virtual void parse_temps_(const char *buf, size_t len) override;
+
+private:
+	int parse_value_(const char *buf, size_t len);
+
+	const string zone_;
+	PersistentFile file_;
+	bool use_netlink_;
+	shared_ptr<ThermalNetlink> netlink_;
+	opt<int> zone_id_;
 };
 
 
@@ -111,18 +241,26 @@ public:
 		opt<unsigned int> max_errors = nullopt
 	);
 
+	virtual int batch_fd() const override;
+
+	/// /proc/acpi/ibm/thermal is a single short line, this is plenty.
+	static constexpr size_t max_data_size = 256;
+
 protected:
 	virtual void init() override;
 	virtual void read_temps_() override;
 	virtual string lookup() override;
 	virtual string type_name() const override;
+	virtual string source() const override;
+	virtual void parse_temps_(const char *buf, size_t len) override;
 
 private:
-	std::char_traits<char>::off_type skip_bytes_;
+	size_t skip_bytes_;
 	static const string skip_prefix_;
-	vector<bool> in_use_;
+	vector<unsigned int> used_indices_;
 	const opt<vector<unsigned int>> temp_indices_;
 	const string conf_path_;
+	PersistentFile file_;
 };
 
 
@@ -132,11 +270,15 @@ public:
 	AtasmartSensorDriver(string device_path, bool optional, opt<vector<int>> correction = nullopt, opt<unsigned int> max_errors = nullopt);
 	virtual ~AtasmartSensorDriver();
 
+	virtual bool blocking() const override;
+
 protected:
 	virtual void init() override;
 	virtual void read_temps_() override;
 	virtual string lookup() override;
 	virtual string type_name() const override;
+	virtual string source() const override;
+	virtual void fetch_temps_() override;
 
 private:
 	SkDisk *disk_;
@@ -149,26 +291,21 @@ private:
 class NvmlSensorDriver : public SensorDriver {
 public:
 	NvmlSensorDriver(string bus_id, bool optional, opt<vector<int>> correction = nullopt, opt<unsigned int> max_errors = nullopt);
-	virtual ~NvmlSensorDriver() noexcept(false) override;
+	virtual ~NvmlSensorDriver() override = default;
+
+	virtual bool blocking() const override;
 
 protected:
 	virtual void init() override;
 	virtual void read_temps_() override;
 	virtual string lookup() override;
 	virtual string type_name() const override;
+	virtual string source() const override;
+	virtual void fetch_temps_() override;
 
 private:
 	const string bus_id_;
-	nvmlDevice_t device_;
-	void *nvml_so_handle_;
-
-	// Pointers to dynamically loaded functions from libnvidia-ml.so
-	nvmlReturn_t (*dl_nvmlInit_v2)();
-	nvmlReturn_t (*dl_nvmlDeviceGetHandleByPciBusId_v2)(const char *, nvmlDevice_t *);
-	nvmlReturn_t (*dl_nvmlDeviceGetName)(nvmlDevice_t, char *, unsigned int);
-	nvmlReturn_t (*dl_nvmlDeviceGetTemperature)(nvmlDevice_t, nvmlTemperatureSensors_t, unsigned int *);
-	nvmlReturn_t (*dl_nvmlShutdown)();
-
+	shared_ptr<NvmlInterface> nvml_iface_;
 };
 #endif /* USE_NVML */
 
@@ -195,11 +332,13 @@ protected:
 	virtual void read_temps_() override;
 	virtual string lookup() override;
 	virtual string type_name() const override;
+	virtual string source() const override;
 
 private:
 	const string chip_name_;
 	const std::vector<string> feature_names_;
 	shared_ptr<LibsensorsInterface> libsensors_iface_;
+	LibsensorsInterface::chip_features features_;
 };
 
 #endif /* USE_LM_SENSORS */
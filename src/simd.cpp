@@ -0,0 +1,186 @@
+/********************************************************************
+ * simd.cpp: Vectorized comparison of temperatures against level limits
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "simd.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define THINKFAN_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace thinkfan {
+
+static_assert(sizeof(int) == sizeof(int32_t), "Temperatures are compared as int32");
+
+
+/*----------------------------------------------------------------------------
+| LimitArray: Aligned, padded int32 copy of a level limit                    |
+----------------------------------------------------------------------------*/
+
+LimitArray::LimitArray(const vector<int> &limit)
+: size_(limit.size())
+{
+	// std::aligned_alloc() wants a multiple of the alignment, which also gives us the padding
+	size_t bytes = (size_ * sizeof(int32_t) + alignment - 1) / alignment * alignment;
+	if (!bytes)
+		bytes = alignment;
+	data_.reset(static_cast<int32_t *>(std::aligned_alloc(alignment, bytes)));
+	if (!data_)
+		throw std::bad_alloc();
+	std::memset(data_.get(), 0, bytes);
+	std::memcpy(data_.get(), limit.data(), size_ * sizeof(int32_t));
+}
+
+const int32_t *LimitArray::data() const
+{ return data_.get(); }
+
+size_t LimitArray::size() const
+{ return size_; }
+
+void LimitArray::free_deleter::operator() (int32_t *p) const
+{ std::free(p); }
+
+
+
+namespace simd {
+
+/*----------------------------------------------------------------------------
+| Scalar fallback                                                            |
+----------------------------------------------------------------------------*/
+
+static bool any_ge_scalar(const int32_t *temps, const int32_t *limits, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		if (temps[i] >= limits[i])
+			return true;
+	return false;
+}
+
+static bool all_lt_scalar(const int32_t *temps, const int32_t *limits, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		if (temps[i] >= limits[i])
+			return false;
+	return true;
+}
+
+
+#ifdef THINKFAN_X86_KERNELS
+
+/*----------------------------------------------------------------------------
+| SSE4.1: 4 temperatures per compare                                         |
+----------------------------------------------------------------------------*/
+
+/// @brief Index of the first i in [0, n) where temps[i] >= limits[i], or n
+__attribute__((target("sse4.1")))
+static size_t first_ge_sse41(const int32_t *temps, const int32_t *limits, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i *>(temps + i));
+		__m128i l = _mm_load_si128(reinterpret_cast<const __m128i *>(limits + i));
+		// All lanes are below their limit iff limit > temp everywhere
+		if (!_mm_test_all_ones(_mm_cmpgt_epi32(l, t)))
+			return i;
+	}
+	return i;
+}
+
+__attribute__((target("sse4.1")))
+static bool any_ge_sse41(const int32_t *temps, const int32_t *limits, size_t n)
+{
+	size_t i = first_ge_sse41(temps, limits, n);
+	return any_ge_scalar(temps + i, limits + i, n - i);
+}
+
+__attribute__((target("sse4.1")))
+static bool all_lt_sse41(const int32_t *temps, const int32_t *limits, size_t n)
+{
+	size_t i = first_ge_sse41(temps, limits, n);
+	return all_lt_scalar(temps + i, limits + i, n - i);
+}
+
+
+/*----------------------------------------------------------------------------
+| AVX2: 8 temperatures per compare                                           |
+----------------------------------------------------------------------------*/
+
+__attribute__((target("avx2")))
+static size_t first_ge_avx2(const int32_t *temps, const int32_t *limits, size_t n)
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i t = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(temps + i));
+		__m256i l = _mm256_load_si256(reinterpret_cast<const __m256i *>(limits + i));
+		if (_mm256_movemask_epi8(_mm256_cmpgt_epi32(l, t)) != -1)
+			return i;
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static bool any_ge_avx2(const int32_t *temps, const int32_t *limits, size_t n)
+{
+	size_t i = first_ge_avx2(temps, limits, n);
+	return any_ge_scalar(temps + i, limits + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static bool all_lt_avx2(const int32_t *temps, const int32_t *limits, size_t n)
+{
+	size_t i = first_ge_avx2(temps, limits, n);
+	return all_lt_scalar(temps + i, limits + i, n - i);
+}
+
+#endif // THINKFAN_X86_KERNELS
+
+
+vector<Kernels> supported_kernels()
+{
+	vector<Kernels> rv;
+#ifdef THINKFAN_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		rv.push_back({ "avx2", any_ge_avx2, all_lt_avx2 });
+	if (__builtin_cpu_supports("sse4.1"))
+		rv.push_back({ "sse4.1", any_ge_sse41, all_lt_sse41 });
+#endif
+	rv.push_back({ "scalar", any_ge_scalar, all_lt_scalar });
+	return rv;
+}
+
+static const Kernels kernels = supported_kernels().front();
+
+
+bool any_ge(const int32_t *temps, const int32_t *limits, size_t n)
+{ return kernels.any_ge(temps, limits, n); }
+
+bool all_lt(const int32_t *temps, const int32_t *limits, size_t n)
+{ return kernels.all_lt(temps, limits, n); }
+
+
+} // namespace simd
+
+} // namespace thinkfan
@@ -0,0 +1,78 @@
+#pragma once
+
+/********************************************************************
+ * simd.h: Vectorized comparison of temperatures against level limits
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "thinkfan.h"
+
+#include <cstdint>
+
+namespace thinkfan {
+
+
+/** @brief A read-only copy of a temperature limit in contiguous int32 storage that is aligned
+ *  to (and zero-padded up to) the width of the widest vector unit we use. */
+class LimitArray {
+public:
+	static constexpr size_t alignment = 32;
+
+	LimitArray(const vector<int> &limit);
+	LimitArray(const LimitArray &) = delete;
+
+	const int32_t *data() const;
+	size_t size() const;
+
+private:
+	struct free_deleter {
+		void operator() (int32_t *p) const;
+	};
+
+	std::unique_ptr<int32_t[], free_deleter> data_;
+	size_t size_;
+};
+
+
+namespace simd {
+
+/* Both kernels are picked once at startup, depending on what the CPU supports (AVX2, SSE4.1 or
+ * plain scalar code). @a temps may be unaligned, @a limits must come from a @a LimitArray. */
+
+/// @return true if @a temps[i] >= @a limits[i] for any i < @a n
+bool any_ge(const int32_t *temps, const int32_t *limits, size_t n);
+
+/// @return true if @a temps[i] < @a limits[i] for all i < @a n
+bool all_lt(const int32_t *temps, const int32_t *limits, size_t n);
+
+
+/// @brief One implementation of the kernels above.
+struct Kernels {
+	const char *name;
+	bool (*any_ge)(const int32_t *temps, const int32_t *limits, size_t n);
+	bool (*all_lt)(const int32_t *temps, const int32_t *limits, size_t n);
+};
+
+/// @return All implementations the CPU supports, the one that's picked at startup first.
+vector<Kernels> supported_kernels();
+
+} // namespace simd
+
+
+} // namespace thinkfan
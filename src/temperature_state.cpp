@@ -22,26 +22,44 @@
 #include "temperature_state.h"
 #include "error.h"
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
 
 namespace thinkfan {
 
 
 TemperatureState::TemperatureState(unsigned int num_temps)
-: temps_(num_temps, 0),
-  biases_(num_temps, 0),
-  biased_temps_(num_temps, 0),
+: block_(nullptr, std::free),
+  num_temps_(num_temps),
   refd_temps_(0),
-  tmax(biased_temps_.begin())
-{}
+  fast_rise_(false)
+{
+	// Pad each array to a whole number of cache lines
+	const size_t stride = (num_temps * sizeof(int) + alignment - 1) / alignment * alignment;
+	const size_t history_bytes = num_temps * history_size * sizeof(int);
+	const size_t bytes = std::max(4 * stride + history_bytes, alignment);
+
+	char *block = static_cast<char *>(std::aligned_alloc(alignment, bytes));
+	if (!block)
+		throw std::bad_alloc();
+	std::memset(block, 0, bytes);
+	block_.reset(block);
+
+	temps_ = reinterpret_cast<int *>(block);
+	biased_temps_ = reinterpret_cast<int *>(block + stride);
+	biases_ = reinterpret_cast<float *>(block + 2 * stride);
+	samples_ = reinterpret_cast<uint32_t *>(block + 3 * stride);
+	history_ = reinterpret_cast<int *>(block + 4 * stride);
+
+	tmax = biased_temps_;
+}
 
 TemperatureState::Ref::Ref(TemperatureState &ts, unsigned int offset)
-: temp0_(ts.temps_.begin() + offset),
-  bias0_(ts.biases_.begin() + offset),
-  biased_temp0_(ts.biased_temps_.begin() + offset),
-  temp_(temp0_),
-  bias_(bias0_),
-  biased_temp_(biased_temp0_),
-  tstate_(&ts)
+: tstate_(&ts),
+  offset_(offset),
+  idx_(offset)
 {}
 
 
@@ -50,76 +68,110 @@ TemperatureState::Ref::Ref()
 {}
 
 void TemperatureState::Ref::restart()
-{
-	temp_ = temp0_;
-	bias_ = bias0_;
-	biased_temp_ = biased_temp0_;
-}
+{ idx_ = offset_; }
 
 
 void TemperatureState::Ref::add_temp(int t)
 {
-	int diff = *temp_ > 0 ?
-		t - *temp_
+	int &temp = tstate_->temps_[idx_];
+	float &bias = tstate_->biases_[idx_];
+	int &biased_temp = tstate_->biased_temps_[idx_];
+
+	int diff = temp > 0 ?
+		t - temp
 		: 0;
-	*temp_ = t;
+	temp = t;
+	tstate_->record_(idx_, t);
 
 	if (unlikely(diff > 2)) {
-		// Apply bias_ if temperature changed quickly
-		*bias_ = int(float(diff) * bias_level);
-
-		if (tmp_sleeptime > seconds(2))
-			tmp_sleeptime = seconds(2);
+		// Apply bias if temperature changed quickly
+		bias = int(float(diff) * bias_level);
+		// Makes the main loop shorten the sleeptime (cf. adapt_sleeptime())
+		tstate_->fast_rise_ = true;
 	}
 	else {
-		// Slowly return to normal sleeptime
-		if (unlikely(tmp_sleeptime < sleeptime))
-			tmp_sleeptime++;
-		// slowly reduce the bias_
+		// slowly reduce the bias
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wfloat-equal" // bias is set to 0 explicitly
-		if (unlikely(*bias_ != 0)) {
+		if (unlikely(bias != 0)) {
 #pragma GCC diagnostic pop
-			if (std::abs(*bias_) < 0.5f)
-				*bias_ = 0;
+			if (std::abs(bias) < 0.5f)
+				bias = 0;
 			else
-				*bias_ -= std::copysign(1 + std::abs(*bias_)/5, *bias_);
+				bias -= std::copysign(1 + std::abs(bias)/5, bias);
 		}
 	}
 
-	*biased_temp_ = *temp_ + int(*bias_);
+	biased_temp = temp + int(bias);
 
-	if (*biased_temp_ > *tstate_->tmax)
-		tstate_->tmax = biased_temp_;
+	if (biased_temp > *tstate_->tmax)
+		tstate_->tmax = &biased_temp;
 
 	skip_temp();
 }
 
 void TemperatureState::Ref::skip_temp()
+{ ++idx_; }
+
+
+
+void TemperatureState::record_(unsigned int idx, int t)
 {
-	++temp_;
-	++bias_;
-	++biased_temp_;
+	uint32_t &n = samples_[idx];
+	history_[idx * history_size + n % history_size] = t;
+	// Skip over 0 when wrapping around so the history stays full (and in order)
+	if (unlikely(++n == 0))
+		n = history_size;
 }
 
+unsigned int TemperatureState::history_depth(unsigned int idx) const
+{ return std::min(samples_[idx], uint32_t(history_size)); }
 
+int TemperatureState::history(unsigned int idx, unsigned int age) const
+{ return history_[idx * history_size + (samples_[idx] - 1 - age) % history_size]; }
+
+bool TemperatureState::steady(unsigned int depth, int spread) const
+{
+	for (unsigned int idx = 0; idx < num_temps_; ++idx) {
+		if (history_depth(idx) < depth)
+			return false;
+		int lo = history(idx, 0), hi = lo;
+		for (unsigned int age = 1; age < depth; ++age) {
+			lo = std::min(lo, history(idx, age));
+			hi = std::max(hi, history(idx, age));
+		}
+		if (hi - lo > spread)
+			return false;
+	}
+	return true;
+}
 
-const vector<int> & TemperatureState::biased_temps() const
-{ return biased_temps_; }
 
-const vector<int> & TemperatureState::temps() const
-{ return temps_; }
+ArrayView<int> TemperatureState::biased_temps() const
+{ return { biased_temps_, num_temps_ }; }
 
-const vector<float> & TemperatureState::biases() const
-{ return biases_; }
+ArrayView<int> TemperatureState::temps() const
+{ return { temps_, num_temps_ }; }
+
+ArrayView<float> TemperatureState::biases() const
+{ return { biases_, num_temps_ }; }
 
 void TemperatureState::reset_refd_count()
 { refd_temps_ = 0; }
 
+bool TemperatureState::take_fast_rise()
+{ return std::exchange(fast_rise_, false); }
+
+void TemperatureState::update_tmax()
+{
+	if (num_temps_)
+		tmax = std::max_element(biased_temps_, biased_temps_ + num_temps_);
+}
+
 
 TemperatureState::Ref TemperatureState::ref(unsigned int num_temps)
 {
-	if (refd_temps_ + num_temps > temps_.size())
+	if (refd_temps_ + num_temps > num_temps_)
 		throw Bug("Attempting to reference uninitialized temperature state");
 
 	auto ref = TemperatureState::Ref(*this, refd_temps_);
@@ -23,13 +23,43 @@
 
 #include "thinkfan.h"
 
+#include <cstdint>
+#include <algorithm>
+
 namespace thinkfan {
 
 
+/// @brief Read-only view of a contiguous array in a @a TemperatureState.
+template<typename T>
+class ArrayView {
+public:
+	ArrayView(const T *data, size_t size)
+	: data_(data), size_(size)
+	{}
+
+	const T *begin() const { return data_; }
+	const T *end() const { return data_ + size_; }
+	const T *cbegin() const { return begin(); }
+	const T *cend() const { return end(); }
+	const T *data() const { return data_; }
+	size_t size() const { return size_; }
+	const T &operator [] (size_t i) const { return data_[i]; }
+
+	bool operator == (const ArrayView<T> &other) const
+	{ return size_ == other.size_ && std::equal(begin(), end(), other.begin()); }
+
+private:
+	const T *data_;
+	size_t size_;
+};
+
+
+/** @brief All temperatures in a single cache-aligned block of memory, one array per quantity:
+ *  The current temperatures, their biases and the biased temperatures, plus a ring buffer with
+ *  the last @a history_size readings of each temperature. */
 class TemperatureState {
 public:
-	template<typename T>
-	using Iter = typename vector<T>::iterator;
+	static constexpr unsigned int history_size = 16;
 
 	class Ref {
 	public:
@@ -42,35 +72,56 @@ public:
 		friend TemperatureState;
 		Ref(TemperatureState &ts, unsigned int offset);
 
-		Iter<int> temp0_;
-		Iter<float> bias0_;
-		Iter<int> biased_temp0_;
-
-		Iter<int> temp_;
-		Iter<float> bias_;
-		Iter<int> biased_temp_;
-
 		TemperatureState *tstate_;
+		unsigned int offset_;
+		unsigned int idx_;
 	};
 
 	TemperatureState(unsigned int num_temps);
 
-	const vector<int> &biased_temps() const;
-	const vector<int> &temps() const;
-	const vector<float> &biases() const;
+	ArrayView<int> biased_temps() const;
+	ArrayView<int> temps() const;
+	ArrayView<float> biases() const;
+
+	/// @return The number of readings in the history of temperature @a idx (at most @a history_size).
+	unsigned int history_depth(unsigned int idx) const;
+
+	/// @return Temperature @a idx as it was read @a age readings ago (unbiased, 0 is the current one).
+	/// @a age must be less than @a history_depth(idx).
+	int history(unsigned int idx, unsigned int age) const;
+
+	/// @return true if each temperature has been read at least @a depth times (at most @a history_size),
+	/// and its last @a depth readings are no more than @a spread °C apart.
+	bool steady(unsigned int depth, int spread) const;
 
 	Ref ref(unsigned int num_temps);
 
 	void reset_refd_count();
 
+	/// @return true if a temperature has risen by more than 2 °C in one reading since the last call.
+	bool take_fast_rise();
+
+	/** @brief Point @a tmax at the highest biased temperature. Must be called after each round of reads,
+	 *  since @a Ref::add_temp() can only move @a tmax up, and some sensors may not have been read at all. */
+	void update_tmax();
+
 private:
-	vector<int> temps_;
-	vector<float> biases_;
-	vector<int> biased_temps_;
+	static constexpr size_t alignment = 64;
+
+	void record_(unsigned int idx, int t);
+
+	std::unique_ptr<void, void (*)(void *)> block_;
+	unsigned int num_temps_;
+	int *temps_;
+	float *biases_;
+	int *biased_temps_;
+	uint32_t *samples_;
+	int *history_;
 	unsigned int refd_temps_;
+	bool fast_rise_;
 
 public:
-	vector<int>::const_iterator tmax;
+	const int *tmax;
 };
 
 
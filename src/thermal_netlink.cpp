@@ -0,0 +1,271 @@
+/********************************************************************
+ * thermal_netlink.cpp: Trip point events from the kernel's thermal framework
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "thermal_netlink.h"
+#include "error.h"
+#include "message.h"
+
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/thermal.h>
+
+namespace thinkfan {
+
+std::weak_ptr<ThermalNetlink> ThermalNetlink::instance_;
+
+
+/// @brief Call @a fn(type, data, len) for each netlink attribute in [@a p, @a p + @a len).
+template<class FnT>
+static void for_each_attr(const char *p, size_t len, FnT fn)
+{
+	while (len >= NLA_HDRLEN) {
+		const struct nlattr *attr = reinterpret_cast<const struct nlattr *>(p);
+		if (attr->nla_len < NLA_HDRLEN || attr->nla_len > len)
+			return;
+		fn(attr->nla_type & NLA_TYPE_MASK, p + NLA_HDRLEN, size_t(attr->nla_len - NLA_HDRLEN));
+		size_t step = std::min(size_t(NLA_ALIGN(attr->nla_len)), len);
+		p += step;
+		len -= step;
+	}
+}
+
+
+template<class T>
+static T attr_value(const char *data, size_t len)
+{
+	T rv = 0;
+	std::memcpy(&rv, data, std::min(sizeof(T), len));
+	return rv;
+}
+
+
+ThermalNetlink::ThermalNetlink()
+: sock_(-1)
+, family_id_(0)
+, group_id_(0)
+{
+#ifndef THERMAL_GENL_FAMILY_NAME
+	throw SystemError("Thermal netlink events are not supported by this build (kernel headers too old).");
+#else
+	if ((sock_ = ::socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC)) < 0) {
+		string msg = strerror(errno);
+		throw SystemError("Failed to open generic netlink socket: " + msg);
+	}
+
+	try {
+		struct sockaddr_nl addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.nl_family = AF_NETLINK;
+		if (::bind(sock_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr))) {
+			string msg = strerror(errno);
+			throw SystemError("Failed to bind generic netlink socket: " + msg);
+		}
+
+		// The family lookup is the only request we make, so don't wait for the answer forever.
+		struct timeval timeout = { 1, 0 };
+		::setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		resolve_family_();
+
+		if (::setsockopt(sock_, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group_id_, sizeof(group_id_))) {
+			string msg = strerror(errno);
+			throw SystemError("Failed to subscribe to thermal netlink events: " + msg);
+		}
+
+		::fcntl(sock_, F_SETFL, ::fcntl(sock_, F_GETFL) | O_NONBLOCK);
+	} catch (...) {
+		::close(sock_);
+		throw;
+	}
+
+	log(TF_DBG) << "Subscribed to thermal netlink events." << flush;
+#endif
+}
+
+
+ThermalNetlink::~ThermalNetlink()
+{
+	if (sock_ >= 0)
+		::close(sock_);
+}
+
+
+shared_ptr<ThermalNetlink> ThermalNetlink::instance()
+{
+	shared_ptr<ThermalNetlink> rv;
+	if (instance_.expired()) {
+		rv.reset(new ThermalNetlink());
+		instance_ = rv;
+	}
+	else
+		rv = instance_.lock();
+
+	return rv;
+}
+
+
+void ThermalNetlink::resolve_family_()
+{
+#ifdef THERMAL_GENL_FAMILY_NAME
+	const char family_name[] = THERMAL_GENL_FAMILY_NAME;
+	struct {
+		struct nlmsghdr nlh;
+		struct genlmsghdr genl;
+		char attrs[NLA_ALIGN(NLA_HDRLEN + sizeof(family_name))];
+	} req;
+	std::memset(&req, 0, sizeof(req));
+
+	struct nlattr *name_attr = reinterpret_cast<struct nlattr *>(req.attrs);
+	name_attr->nla_type = CTRL_ATTR_FAMILY_NAME;
+	name_attr->nla_len = NLA_HDRLEN + sizeof(family_name);
+	std::memcpy(req.attrs + NLA_HDRLEN, family_name, sizeof(family_name));
+
+	req.nlh.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN + sizeof(req.attrs));
+	req.nlh.nlmsg_type = GENL_ID_CTRL;
+	req.nlh.nlmsg_flags = NLM_F_REQUEST;
+	req.nlh.nlmsg_seq = 1;
+	req.genl.cmd = CTRL_CMD_GETFAMILY;
+	req.genl.version = 1;
+
+	if (::send(sock_, &req, req.nlh.nlmsg_len, 0) < 0) {
+		string msg = strerror(errno);
+		throw SystemError("Failed to query thermal netlink family: " + msg);
+	}
+
+	char buf[4096];
+	ssize_t len = ::recv(sock_, buf, sizeof(buf), 0);
+	if (len < 0) {
+		string msg = strerror(errno);
+		throw SystemError("Failed to query thermal netlink family: " + msg);
+	}
+
+	for (const struct nlmsghdr *nlh = reinterpret_cast<const struct nlmsghdr *>(buf);
+			NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+		if (nlh->nlmsg_type == NLMSG_ERROR) {
+			const struct nlmsgerr *err = reinterpret_cast<const struct nlmsgerr *>(NLMSG_DATA(nlh));
+			throw SystemError(string("Kernel has no thermal netlink support: ") + strerror(-err->error));
+		}
+		if (nlh->nlmsg_type != GENL_ID_CTRL || nlh->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN))
+			continue;
+
+		const char *attrs = reinterpret_cast<const char *>(NLMSG_DATA(nlh)) + GENL_HDRLEN;
+		for_each_attr(attrs, nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN), [&] (int type, const char *data, size_t len) {
+			if (type == CTRL_ATTR_FAMILY_ID)
+				family_id_ = attr_value<uint16_t>(data, len);
+			else if (type == CTRL_ATTR_MCAST_GROUPS) {
+				for_each_attr(data, len, [&] (int, const char *grp, size_t grp_len) {
+					string name;
+					uint32_t id = 0;
+					for_each_attr(grp, grp_len, [&] (int type, const char *data, size_t len) {
+						if (type == CTRL_ATTR_MCAST_GRP_NAME)
+							name = string(data, strnlen(data, len));
+						else if (type == CTRL_ATTR_MCAST_GRP_ID)
+							id = attr_value<uint32_t>(data, len);
+					});
+					if (name == THERMAL_GENL_EVENT_GROUP_NAME)
+						group_id_ = id;
+				});
+			}
+		});
+	}
+
+	if (!family_id_ || !group_id_)
+		throw SystemError("Kernel has no thermal netlink event group.");
+#endif
+}
+
+
+int ThermalNetlink::fd() const
+{ return sock_; }
+
+void ThermalNetlink::add_zone(int zone_id)
+{ zones_.insert(zone_id); }
+
+void ThermalNetlink::remove_zone(int zone_id)
+{
+	auto it = zones_.find(zone_id);
+	if (it != zones_.end())
+		zones_.erase(it);
+}
+
+
+bool ThermalNetlink::handle_events()
+{
+	char buf[8192];
+	bool rv = false;
+
+	while (true) {
+		ssize_t len = ::recv(sock_, buf, sizeof(buf), MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS) {
+				// Socket buffer overrun, we may have missed something
+				rv = true;
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				log(TF_WRN) << "Reading thermal netlink events: " << strerror(errno) << flush;
+			break;
+		}
+		if (len == 0)
+			break;
+		rv |= parse_events(buf, size_t(len), family_id_, zones_);
+	}
+
+	return rv;
+}
+
+
+bool ThermalNetlink::parse_events(const char *buf, size_t len, uint16_t family_id, const std::multiset<int> &zones)
+{
+	bool rv = false;
+#ifdef THERMAL_GENL_FAMILY_NAME
+	// Signed, so NLMSG_NEXT() can't wrap around on a truncated last message
+	ssize_t remaining = ssize_t(len);
+	for (const struct nlmsghdr *nlh = reinterpret_cast<const struct nlmsghdr *>(buf);
+			NLMSG_OK(nlh, remaining); nlh = NLMSG_NEXT(nlh, remaining)) {
+		if (nlh->nlmsg_type != family_id || nlh->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN))
+			continue;
+
+		const struct genlmsghdr *genl = reinterpret_cast<const struct genlmsghdr *>(NLMSG_DATA(nlh));
+		if (genl->cmd != THERMAL_GENL_EVENT_TZ_TRIP_UP && genl->cmd != THERMAL_GENL_EVENT_TZ_TRIP_DOWN)
+			continue;
+
+		const char *attrs = reinterpret_cast<const char *>(genl) + GENL_HDRLEN;
+		for_each_attr(attrs, nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN), [&] (int type, const char *data, size_t len) {
+			if (type == THERMAL_GENL_ATTR_TZ_ID && zones.count(int(attr_value<uint32_t>(data, len))))
+				rv = true;
+		});
+	}
+#else
+	(void)buf; (void)len; (void)family_id; (void)zones;
+#endif
+	return rv;
+}
+
+
+}
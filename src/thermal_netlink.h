@@ -0,0 +1,72 @@
+/********************************************************************
+ * thermal_netlink.h: Trip point events from the kernel's thermal framework
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#pragma once
+
+#include "thinkfan.h"
+
+#include <set>
+#include <cstdint>
+
+namespace thinkfan {
+
+
+/** @brief A generic netlink socket subscribed to the "event" multicast group of the "thermal"
+ * family. It's shared by all @a ThermalZoneSensorDriver instances that want trip point events
+ * and stays open for as long as one of them holds a reference. */
+class ThermalNetlink
+{
+public:
+	~ThermalNetlink();
+	ThermalNetlink(const ThermalNetlink &) = delete;
+	ThermalNetlink(ThermalNetlink &&) = delete;
+
+	/// @brief Throws SystemError if the kernel doesn't have thermal netlink support.
+	static shared_ptr<ThermalNetlink> instance();
+
+	/// @return A non-blocking fd that becomes readable (POLLIN) when there are events.
+	int fd() const;
+
+	void add_zone(int zone_id);
+	void remove_zone(int zone_id);
+
+	/** @brief Consume all pending events.
+	 *  @return true if a trip point of any added zone was crossed (or events were lost). */
+	bool handle_events();
+
+	/** @brief Look for trip point crossings of @a zones in @a len bytes of netlink messages.
+	 *  Messages that aren't from @a family_id are ignored. */
+	static bool parse_events(const char *buf, size_t len, uint16_t family_id, const std::multiset<int> &zones);
+
+private:
+	ThermalNetlink();
+	void resolve_family_();
+
+	static std::weak_ptr<ThermalNetlink> instance_;
+
+	int sock_;
+	uint16_t family_id_;
+	uint32_t group_id_;
+	std::multiset<int> zones_;
+};
+
+
+}
@@ -7,7 +7,10 @@ thinkfan \- A simple fan control program
 .OP \-b BIAS
 .OP \-c CONFIG
 .OP \-s SECONDS
+.OP \-m SECONDS
+.OP \-i SECONDS
 .OP \-p \fR[\fIDELAY\fR]\fI
+.OP \-t SECONDS
 .YS
 
 
@@ -71,6 +74,17 @@ documentation.
 \(bu pwm*_enable and pwm? files in sysfs
 Provided by all modern hardware monitoring drivers, including thinkpad_acpi.
 
+.PP
+Every 10 seconds, thinkfan reads back the actual state of each fan: Its speed
+in RPM (from the \fBspeed:\fR line in /proc/acpi/ibm/fan or from the matching
+fan*_input file in sysfs, if there is one), and whether it is still at the
+speed that thinkfan has set.
+The RPM are shown next to the fan speeds in the log.
+If a fan should be turning but reports 0 RPM twice in a row, thinkfan warns
+that it may be stalled or blocked.
+If the firmware has taken over control of a fan (e.g. the pwm*_enable file has
+been reset), thinkfan warns about it and re\-initializes fan control.
+
 
 .SS Mapping temperatures to fan speeds
 
@@ -110,6 +124,16 @@ for actually functional config. For a complete reference see the config man
 page
 .BR thinkfan.conf (5).
 
+Searching sysfs for hwmons that are configured by
+.B name
+or
+.B model
+can be slow, so the results are kept in
+.BR @CACHE_DIR@/config.cache .
+They are only reused for the exact same config file and only if the hwmon
+they point to still has the configured name or model, so thinkfan simply
+searches again if anything has changed.
+
 
 
 .SH OPTIONS
@@ -120,7 +144,31 @@ Show a short help message
 
 .TP
 .BI \-s " SECONDS"
-Maximum seconds between temperature updates (default: 5)
+Maximum seconds between temperature updates (floating\-point, 0.1\-15s).
+Default: 5
+
+.TP
+.BI \-m " SECONDS"
+Seconds between temperature updates while temperatures are rising quickly
+(floating\-point, 0.1\-15s).
+As soon as a temperature increases by more than 2 \[char176]C from one reading
+to the next, thinkfan shortens its cycle to this value.
+Afterwards, each cycle is one and a half times as long as the previous one,
+until the time given by \fB\-s\fR is reached again.
+Default: 2
+
+.TP
+.BI \-i " SECONDS"
+Maximum seconds between temperature updates while temperatures are stable
+(floating\-point, 0.1\-600s).
+When the last few readings of every sensor lie within 1 \[char176]C of each
+other and all temperatures are more than 3 \[char176]C away from the next
+level change, thinkfan keeps stretching its cycle by one half beyond the time
+given by \fB\-s\fR, up to this value.
+Any significant temperature change brings it back to normal.
+If the fan driver has a watchdog, the cycle is kept short enough to reset it
+in time.
+Default: Same as \fB\-s\fR (disabled)
 
 .TP
 .BI \-b " BIAS"
@@ -191,6 +239,17 @@ displayed/logged.
 Use the pulsing\-fan workaround (for older Thinkpads). Takes an optional
 floating\-point argument (0\-10s) as depulsing duration. Default 0.5s.
 
+.TP
+.BI \-t " SECONDS"
+Maximum time to wait for slow sensors in each cycle (floating\-point, 0\-60s).
+Sensors that may block for a long time (currently NVML and S.M.A.R.T.) are
+read concurrently in the background.
+If such a sensor hasn't answered when this time is up, thinkfan continues with
+its last known temperature, just as if a tolerable read error had occurred
+(cf. \fBoptional\fR and \fBmax_errors\fR in
+.BR thinkfan.conf (5)).
+Default 1.0s.
+
 .TP
 .B \-d
 Do not read temperature from sleeping disks. Instead, 0 \[char176]C is used as that
@@ -210,9 +269,13 @@ terminate cleanly.
 .P
 SIGHUP makes thinkfan reload its config. If there's any problem with the new
 config, we keep the old one.
+Sensors and fans whose entries haven't changed are kept as they are, so
+reloading doesn't reset their fan control or temperature history.
+Only new or modified entries are (re\-)initialized.
 .P
-SIGUSR1 causes thinkfan to dump all currently known temperatures either to
-syslog, or to the console (if running with the \-n option).
+SIGUSR1 causes thinkfan to dump all currently known temperatures and fan
+speeds (including the last RPM reading, if available) either to syslog, or to
+the console (if running with the \-n option).
 .P
 SIGPWR tells thinkfan that the system is about to go to sleep. Thinkfan will
 then allow sensor read errors for the next 4 loops because many sensors will
@@ -70,11 +70,12 @@ section below).
 
 The entries under the
 .B sensors:
-section can specify sysfs/hwmon, lm_sensors, thinkpad_acpi, NVML or atasmart drivers.
+section can specify sysfs/hwmon, thermal zone, lm_sensors, thinkpad_acpi, NVML or atasmart drivers.
 Support for lm_sensors, NVML and atasmart requires the appropriate libraries
 and must have been enabled at compile time.
 There can be any number (greater than zero) and combination of
 .BR hwmon ,
+.BR thermal ,
 .BR tpacpi ,
 .BR nvml
 and
@@ -94,6 +95,10 @@ The syntax for identifying each type of sensors looks as follows:
 \f[CB]    name: \f[CI]hwmon-name\f[CR]           # Optional entry
 \f[CB]    model: \f[CI]hwmon-model\f[CR]         # Optional entry for nvme
 \f[CB]    indices: \f[CI]index-list\f[CR]        # Optional entry
+\f[CB]    alarm: \f[CI]bool-use-alarms\f[CR]     # Optional entry
+
+\f[CB]  \- thermal: \f[CI]thermal-zone\f[CR]      # A thermal zone from /sys/class/thermal
+\f[CB]    netlink: \f[CI]bool-use-events\f[CR]   # Optional entry
 
 \f[CB]  \- chip: \f[CI]chip-name\f[CR]            # An lm_sensors/libsensors chip...
 \f[CB]    ids: \f[CI]id-list\f[CR]               # ... with some feature IDs
@@ -120,6 +125,7 @@ behavior:
 \f[CB]    correction: \f[CI]correction-list\f[CR]  # Optional entry
 \f[CB]    optional: \f[CI]bool-ignore-errors\f[CR] # Optional entry
 \f[CB]    max_errors: \f[CI]num-max-errors\f[CR]   # Optional entry
+\f[CB]    interval: \f[CI]seconds\f[CR]            # Optional entry
 \fR
 .fi
 
@@ -161,6 +167,8 @@ under the \fBlevels:\fR keyword:
 \f[CB]    optional: \f[CI]bool-ignore-errors\f[CR] # Optional entry
 \f[CB]    max_errors: \f[CI]num-max-errors\f[CR]   # Optional entry
 \f[CB]    levels: \f[CI]levels-section\f[CR]       # Optional entry
+\f[CB]    curve: \f[CI]curve-section\f[CR]         # Optional entry, hwmon only
+\f[CB]    pid: \f[CI]pid-section\f[CR]             # Optional entry, hwmon only
 
 
 .SS Values
@@ -236,6 +244,43 @@ For example, you might have an NVME \*(lq/sys/class/hwmon/hwmon3/device/model\*(
 and you might have an external NVME over USB or Thunderbolt that you don't want
 to monitor or you might have two NVME's.
 
+.TP
+.IR bool-use-alarms " (optional, \fBfalse\fR by default)"
+If set to \fBtrue\fR, thinkfan sets the
+\*(lqtemp\fIN\fR_max\*(rq and \*(lqtemp\fIN\fR_min\*(rq limits of each
+\*(lqtemp\fIN\fR_input\*(rq sensor to the boundaries of the current fan
+level and waits for the corresponding alarm instead of polling the sensor.
+The original limits are restored on exit.
+This requires the hwmon driver to signal its
+\*(lqtemp\fIN\fR_alarm\*(rq (or \*(lqtemp\fIN\fR_max_alarm\*(rq and
+\*(lqtemp\fIN\fR_min_alarm\*(rq) attributes, which not all drivers do.
+If all sensors have working alarms, thinkfan reads them only every 30 seconds
+unless an alarm goes off.
+Since the alarms are based on the raw temperatures, the bias (cf. option
+\fB-b\fR) only takes effect when thinkfan wakes up.
+
+.TP
+.I thermal-zone
+Either the \*(lqtype\*(rq of a thermal zone, for example
+\*(lq\fBx86_pkg_temp\fR\*(rq or \*(lq\fBacpitz\fR\*(rq, or the full path of a
+thermal zone directory like \*(lq/sys/class/thermal/thermal_zone0\*(rq.
+A type is looked up in the \*(lqtype\*(rq files below
+\*(lq/sys/class/thermal\*(rq, which makes it independent of the (load order
+dependent) zone numbering.
+If more than one zone has the given type, thinkfan refuses to start and the zone
+must be specified by its path instead.
+Types can be listed with \*(lqcat /sys/class/thermal/thermal_zone*/type\*(rq.
+
+.TP
+.IR bool-use-events " (optional, \fBfalse\fR by default)"
+If set to \fBtrue\fR, thinkfan subscribes to the kernel's thermal netlink
+events and wakes up as soon as the zone crosses one of its trip points,
+instead of waiting for its next scheduled read.
+Since trip points are set by the platform and don't coincide with fan levels,
+the zone is still polled as usual.
+If the kernel has no thermal netlink support, a warning is logged and the
+zone is only polled.
+
 .TP
 .I index-list
 A YAML list
@@ -329,8 +374,13 @@ temperatures from a sensor or writing to a fan.
 
 An optional device will not delay startup.
 Instead, thinkfan will commence normal operation with the remaining devices and
-re-try initializing unavailable optional devices in every loop until all are
-found.
+re-try initializing unavailable optional devices until all are found.
+For sensors, the time between attempts starts at 5 seconds and doubles with each
+failure, up to 5 minutes.
+Fans are re-tried in every loop, so they are back under control as soon as
+possible.
+Whenever the kernel reports a new device, all missing devices are looked for
+again right away.
 
 Marking a sensor/fan as optional may be useful for removable hardware or devices
 that may get switched off entirely to save power.
@@ -343,11 +393,25 @@ On startup, thinkfan will attempt to initialize the device \fInum-max-errors\fR
 times before commencing normal operation.
 If the device cannot be initialized after the given number of attempts,
 thinkfan will fail.
+All devices that aren't ready are retried together once per sleep time, so
+one late device doesn't delay the others.
+While thinkfan is waiting, every fan that is already initialized runs at the
+highest speed its config would ever use.
 
 When a device with a positive \fInum-max-errors\fR fails during runtime,
 thinkfan will likewise attempt to re-initialize it the given number of times
 before failing.
 
+.TP
+.IR seconds " (optional, sensors only, thinkfan's sleep time by default)"
+The number of seconds (at least 0.1, fractions are allowed) between two reads
+of the sensor.
+Sensors with an \fBinterval\fR are read on their own schedule and their last
+temperatures are used in between.
+This is useful for sensors that are expensive to read (e.g. hard disks) or for
+sensors that should be read more often than the rest.
+Whenever a sensor is read, the fan speed is re-evaluated.
+
 .TP
 .IR levels-section " (optional, use global levels section by default)"
 As of thinkfan 2.0, multiple fans can be configured.
@@ -504,6 +568,101 @@ An underscore means that the temperature of that sensor should be ignored at
 the given speed level.
 
 
+.SS Fan Curves
+Instead of a
+.B levels:
+section, a
+.B hwmon
+fan can have a
+.B curve:
+section.
+It maps the highest temperature found among all configured sensors directly to a
+PWM value, so the fan speed follows the temperature smoothly instead of jumping
+between a few discrete levels:
+
+.nf
+\fC
+# ...
+\f[CB]fans:
+\f[CB]  \- hwmon: \f[CI]hwmon-path
+\f[CB]    curve:
+\f[CB]      \- [ \f[CI]temperature\f[CB], \f[CI]pwm\f[CB] ]
+\f[CB]      \- \f[CR]...
+\fR
+.fi
+
+The points must be ordered by strictly increasing
+.IR temperature ,
+and each
+.I pwm
+must be in the range
+.BR 0 " to " 255 .
+Between two points, the PWM value is interpolated linearly.
+Below the first and above the last point, the PWM value of that point is used.
+Unless DANGEROUS mode is enabled (cf. option \fB-D\fR), the highest
+.I pwm
+of a curve must be at least \fB128\fR.
+There is no hysteresis, so the fan speed is adjusted on every change of the
+highest temperature.
+
+
+.SS PID Control
+A
+.B hwmon
+fan can also be controlled by a PID controller that adjusts the PWM value to
+hold the highest temperature at a given target.
+Unlike fan levels, which can oscillate between two speeds under a constant load,
+the controller settles on a fixed PWM value and then stops writing to the fan:
+
+.nf
+\fC
+# ...
+\f[CB]fans:
+\f[CB]  \- hwmon: \f[CI]hwmon-path
+\f[CB]    pid:
+\f[CB]      target: \f[CI]temperature
+\f[CB]      kp: \f[CI]p-gain\f[CR]           # Optional entry, default 8
+\f[CB]      ki: \f[CI]i-gain\f[CR]           # Optional entry, default 0.3
+\f[CB]      kd: \f[CI]d-gain\f[CR]           # Optional entry, default 0
+\f[CB]      deadband: \f[CI]degrees\f[CR]    # Optional entry, default 1
+\f[CB]      min_pwm: \f[CI]pwm\f[CR]         # Optional entry, default 0
+\f[CB]      max_pwm: \f[CI]pwm\f[CR]         # Optional entry, default 255
+\fR
+.fi
+
+.TP
+.I p-gain
+PWM units per degree above (or below) the
+.IR target .
+
+.TP
+.I i-gain
+PWM units per degree and second.
+The integral term is limited to the PWM range and stops accumulating while the
+output is at its limit (anti-windup).
+
+.TP
+.I d-gain
+PWM units per degree/second of temperature change.
+Since temperatures are read as whole degrees, this amplifies sensor noise and
+should be kept small.
+
+.TP
+.I degrees
+Deviations from the
+.I target
+up to this many degrees are ignored, so that noise in the temperature readings
+doesn't cause constant fan speed changes.
+
+.TP
+.I pwm
+The PWM range of the controller output, within
+.BR 0 " to " 255 .
+Unless DANGEROUS mode is enabled (cf. option \fB-D\fR),
+.B max_pwm
+must be at least \fB128\fR.
+
+
 .SH SEE ALSO
 The thinkfan manpage:
 .BR thinkfan (1)
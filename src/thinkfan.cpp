@@ -24,6 +24,7 @@
 #include <getopt.h>
 #include <unistd.h>
 #include <cstdlib>
+#include <poll.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 
@@ -43,6 +44,11 @@
 #include "sensors.h"
 #include "fans.h"
 #include "temperature_state.h"
+#include "sampler.h"
+#include "scheduler.h"
+#include "event_loop.h"
+#include "hotplug.h"
+#include "hwmon.h"
 
 
 namespace thinkfan {
@@ -50,15 +56,35 @@ namespace thinkfan {
 bool chk_sanity(true);
 bool quiet(false);
 bool daemonize(true);
-seconds sleeptime(5);
-seconds tmp_sleeptime = sleeptime;
+milliseconds sleeptime(5000);
+milliseconds tmp_sleeptime = sleeptime;
+milliseconds min_sleeptime(2000);
+milliseconds max_sleeptime(0);
 float bias_level(0);
 float depulse = 0;
+secondsf read_deadline(1);
 static TemperatureState temp_state(0);
 std::atomic<unsigned char> tolerate_errors(0);
 
-std::condition_variable sleep_cond;
-std::mutex sleep_mutex;
+// When hwmon alarms cover all sensors, this is how long we sleep at most. Must be well below
+// half the thinkpad_acpi fan watchdog (cf. TpFanDriver::ping_watchdog_and_depulse()).
+static const seconds alarm_timeout(30);
+
+// Temperatures are idle when their last idle_depth readings are at most idle_spread °C apart, and
+// each of them is more than idle_margin °C away from any limit where a fan would change its speed.
+static const unsigned int idle_depth = 4;
+static const int idle_spread = 1;
+static const int idle_margin = 3;
+
+// How often to read back the fans' RPM and actual speed setting. Done on the next control tick after
+// that time, so it never causes an extra wakeup.
+static const seconds feedback_period(10);
+
+// The config that's currently running, for status output on SIGUSR1.
+static const Config *running_config = nullptr;
+
+// Everything the main loop waits for: Deadlines, signals and sensor alarms.
+static unique_ptr<EventLoop> event_loop;
 
 #ifdef USE_YAML
 vector<string> config_files { DEFAULT_YAML_CONFIG, DEFAULT_CONFIG };
@@ -123,35 +149,34 @@ void PidFileHolder::cleanup()
 #endif // defined(PID_FILE)
 
 
-void sleep(thinkfan::seconds duration) {
-	auto until = std::chrono::steady_clock::now() + duration;
+void sleep(thinkfan::milliseconds duration)
+{ sleep_until(std::chrono::steady_clock::now() + duration); }
+
 
-	std::unique_lock<std::mutex> sleep_locked(sleep_mutex);
-	sleep_cond.wait_until(sleep_locked, until, [] () {
-		return interrupted != 0;
-	} );
+void sleep_until(std::chrono::steady_clock::time_point until)
+{
+	vector<int> ready;
+	while (event_loop->wait_until(until, ready) && !interrupted);
 }
 
 
-void sig_handler(int signum) {
+/// @brief Called by the event_loop for each signal we receive, so this is not an async signal handler.
+static void handle_signal(int signum)
+{
 	switch(signum) {
 	case SIGHUP:
 	case SIGINT:
 	case SIGTERM:
 		interrupted = signum;
-		sleep_cond.notify_all();
 		break;
 	case SIGUSR1:
-		log(TF_NFY) << temp_state << flush;
+		if (running_config)
+			log(TF_NFY) << temp_state << " -> " << running_config->fan_configs() << flush;
+		else
+			log(TF_NFY) << temp_state << flush;
 		break;
-#ifndef DISABLE_BUGGER
-	case SIGSEGV:
-		// Let's hope memory isn't too fucked up to get through with this ;)
-		throw Bug("Segmentation fault.");
-#endif
 	case SIGUSR2:
 		interrupted = signum;
-		sleep_cond.notify_all();
 		log(TF_NFY) << "Received SIGUSR2: Re-initializing fan control." << flush;
 		break;
 	case SIGPWR:
@@ -162,45 +187,296 @@ void sig_handler(int signum) {
 }
 
 
+#ifndef DISABLE_BUGGER
+/// @brief SIGSEGV is synchronous and can't be blocked, so it still needs a real signal handler.
+static void segv_handler(int)
+{
+	// Let's hope memory isn't too fucked up to get through with this ;)
+	throw Bug("Segmentation fault.");
+}
+#endif
+
+
+/** @brief Program the alarm windows of all sensors that support them according to the current fan levels.
+ *  @return true if no sensor that's read on the control tick needs to be polled. */
+static bool arm_alarms(const Config &config, vector<int> &lower, vector<int> &upper)
+{
+	lower.assign(config.num_temps(), numeric_limits<int>::min());
+	upper.assign(config.num_temps(), numeric_limits<int>::max());
+
+	bool covered = true;
+	for (auto &fan_config : config.fan_configs())
+		covered &= fan_config->wakeup_limits(lower, upper);
+
+	unsigned int offset = 0;
+	for (auto &sensor : config.sensors()) {
+		if (!sensor->set_alarm_window(&lower[offset], &upper[offset]) && !sensor->interval())
+			covered = false;
+		offset += sensor->num_temps();
+	}
+
+	return covered;
+}
+
+
+/** @brief Nothing's going on: All temperatures are steady, unbiased and well inside the window in
+ *  which no fan speed changes (cf. FanConfig::wakeup_limits()). */
+static bool idle(const Config &config, vector<int> &lower, vector<int> &upper)
+{
+	if (!temp_state.steady(idle_depth, idle_spread) || !(temp_state.biased_temps() == temp_state.temps()))
+		return false;
+
+	lower.assign(config.num_temps(), numeric_limits<int>::min());
+	upper.assign(config.num_temps(), numeric_limits<int>::max());
+	for (auto &fan_config : config.fan_configs())
+		if (!fan_config->wakeup_limits(lower, upper))
+			return false;
+
+	// A fan speeds up when any temperature reaches its upper limit, but it only slows down once
+	// all of them are below their lower limits.
+	ArrayView<int> temps = temp_state.biased_temps();
+	bool above_lower = false;
+	for (size_t i = 0; i < temps.size() && i < lower.size(); ++i) {
+		if (upper[i] != numeric_limits<int>::max() && upper[i] - temps[i] <= idle_margin)
+			return false;
+		above_lower |= lower[i] == numeric_limits<int>::min() || temps[i] - lower[i] > idle_margin;
+	}
+	return above_lower;
+}
+
+
+/// @brief Some device was added, so drivers whose device is missing should look for it right away.
+static void retry_missing(const Config &config)
+{
+	bool missing = false;
+	auto retry = [&] (Driver &drv) {
+		if (!drv.available() || !drv.initialized()) {
+			drv.reset_backoff();
+			missing = true;
+		}
+	};
+
+	for (auto &sensor : config.sensors())
+		retry(*sensor);
+	for (auto &fan_config : config.fan_configs())
+		retry(*fan_config->fan());
+
+	if (missing) {
+		// Whatever lookups have seen of sysfs so far doesn't include the new device
+		SysfsIndex::instance().clear();
+		log(TF_DBG) << "A device was added, looking for missing ones again." << flush;
+	}
+}
+
+
 void run(const Config &config)
 {
 	tmp_sleeptime = sleeptime;
+	const milliseconds idle_sleeptime = std::max(sleeptime, max_sleeptime);
 
-	for (const unique_ptr<SensorDriver> &sensor : config.sensors())
-		sensor->read_temps();
+	const vector<unique_ptr<SensorDriver>> &sensors = config.sensors();
+	SensorSampler sampler(sensors);
+	sampler.read_temps();
+	temp_state.update_tmax();
 
 	// Set initial fan level
 	for (auto &fan_config : config.fan_configs())
 		fan_config->init_fanspeed(temp_state);
 	log(TF_NFY) << temp_state << " -> " << config.fan_configs() << flush;
+	running_config = &config;
+
+	// Sensors with their own interval are scheduled individually by their index in the config.
+	// All others are read on the regular control tick.
+	const unsigned int control_tick = static_cast<unsigned int>(sensors.size());
+	// Fans that are depulsing need to be re-engaged in between control ticks
+	const unsigned int depulse_tick = control_tick + 1;
+	Scheduler scheduler;
+	vector<Scheduler::Entry> wakeups;
+	vector<bool> due(sensors.size(), false);
+
+	vector<pollfd> pollfds;
+	vector<SensorDriver *> alarm_owners;
+	vector<int> ready;
+	vector<int> lower_limits, upper_limits;
+	vector<int> idle_lower, idle_upper;
+
+	// If sensor alarms tell us when a level boundary is crossed, the control tick is just a safety net.
+	auto control_period = [&] () -> milliseconds {
+		pollfds.clear();
+		alarm_owners.clear();
+		for (auto &sensor : sensors) {
+			sensor->alarm_fds(pollfds);
+			alarm_owners.resize(pollfds.size(), sensor.get());
+		}
+		if (!event_loop->set_sources(pollfds) || pollfds.empty())
+			return tmp_sleeptime;
+
+		if (arm_alarms(config, lower_limits, upper_limits)
+				&& tmp_sleeptime >= sleeptime
+				&& temp_state.biased_temps() == temp_state.temps())
+			return std::max(milliseconds(alarm_timeout), tmp_sleeptime);
+		return tmp_sleeptime;
+	};
+
+	// No matter how long the control period gets, fan watchdogs must be pinged in time. If a ping
+	// is overdue because writing to the fan failed, don't spin: The watchdog deadline is only half
+	// the actual timeout.
+	auto next_control_tick = [&] (Scheduler::clock::time_point now) {
+		Scheduler::clock::time_point rv = now + control_period();
+		for (auto &fan_config : config.fan_configs())
+			if (opt<Scheduler::clock::time_point> ping = fan_config->fan()->watchdog_deadline())
+				rv = std::min(rv, std::max(*ping, now + min_sleeptime));
+		return rv;
+	};
+
+	auto now = Scheduler::clock::now();
+	for (unsigned int i = 0; i < sensors.size(); ++i)
+		if (sensors[i]->interval())
+			scheduler.schedule(i, now + *sensors[i]->interval());
+	scheduler.schedule(control_tick, next_control_tick(now));
+	Scheduler::clock::time_point next_feedback = now + feedback_period;
+
+	unique_ptr<HotplugMonitor> hotplug;
+	try {
+		hotplug.reset(new HotplugMonitor());
+		event_loop->add_watch(hotplug->fd());
+	} catch (SystemError &e) {
+		log(TF_DBG) << e.what() << flush;
+		hotplug.reset();
+	}
 
 	bool did_something = false;
 	while (likely(!interrupted)) {
-		sleep(tmp_sleeptime);
+		bool alarm = false;
+		if (event_loop->wait_until(scheduler.next(), ready)) {
+			for (int fd : ready) {
+				if (hotplug && fd == hotplug->fd()) {
+					if (hotplug->handle_events())
+						retry_missing(config);
+					continue;
+				}
+				for (size_t i = 0; i < pollfds.size(); ++i)
+					if (pollfds[i].fd == fd)
+						alarm |= alarm_owners[i]->ack_alarm(fd);
+			}
+		}
 
 		if (unlikely(interrupted))
 			break;
 
-		for (const unique_ptr<SensorDriver> &sensor : config.sensors())
-			sensor->read_temps();
+		now = Scheduler::clock::now();
+		if (alarm)
+			scheduler.schedule(control_tick, now);
+		scheduler.pop_due(now, wakeups);
+		// E.g. a hotplug event or an alarm that turned out to be nothing, so there's nothing to do
+		if (wakeups.empty())
+			continue;
+
+		bool is_control_tick = false;
+		bool reengaged = false;
+		std::fill(due.begin(), due.end(), false);
+		for (const Scheduler::Entry &e : wakeups) {
+			if (e.id == depulse_tick) {
+				for (auto &fan_config : config.fan_configs())
+					fan_config->fan()->end_depulse(now);
+				reengaged = true;
+			}
+			else if (e.id == control_tick) {
+				is_control_tick = true;
+				for (unsigned int i = 0; i < sensors.size(); ++i)
+					if (!sensors[i]->interval())
+						due[i] = true;
+			}
+			else
+				due[e.id] = true;
+		}
 
-		if (unlikely(tolerate_errors) > 0)
+		sampler.read_temps(due);
+		temp_state.update_tmax();
+
+		// React to quickly rising temperatures right away, even if only a sensor with its own
+		// interval has seen them. Only return to the normal sleeptime gradually.
+		// While nothing's going on, stretch the sleeptime up to the idle_sleeptime, but go back to
+		// normal as soon as anything changes.
+		const bool fast_rise = temp_state.take_fast_rise();
+		const bool is_idle = idle_sleeptime > sleeptime && idle(config, idle_lower, idle_upper);
+		const milliseconds prev_sleeptime = tmp_sleeptime;
+		tmp_sleeptime = adapt_sleeptime(tmp_sleeptime, fast_rise, is_control_tick, min_sleeptime,
+			is_idle ? idle_sleeptime : sleeptime);
+		if (!is_control_tick && tmp_sleeptime < prev_sleeptime)
+			scheduler.advance(control_tick, now + tmp_sleeptime);
+
+		if (is_control_tick && unlikely(tolerate_errors) > 0)
 			tolerate_errors--;
 
+		if (is_control_tick && now >= next_feedback) {
+			for (auto &fan_config : config.fan_configs())
+				fan_config->fan()->sample_feedback();
+			next_feedback = now + feedback_period;
+		}
+
 		for (auto &fan_config : config.fan_configs())
 			did_something |= fan_config->set_fanspeed(temp_state);
 
 		if (unlikely(did_something))
 			log(TF_NFY) << temp_state << " -> " << config.fan_configs() << flush;
 
+		// Reschedule after the fans have been handled because that may change tmp_sleeptime
+		// and the alarm windows.
+		for (const Scheduler::Entry &e : wakeups) {
+			if (e.id == control_tick)
+				scheduler.schedule(control_tick, next_control_tick(now));
+			else if (e.id != depulse_tick)
+				scheduler.reschedule(e, now, *sensors[e.id]->interval());
+		}
+		opt<Scheduler::clock::time_point> reengage;
+		for (auto &fan_config : config.fan_configs()) {
+			opt<Scheduler::clock::time_point> deadline = fan_config->fan()->depulse_deadline();
+			if (deadline && (!reengage || *deadline < *reengage))
+				reengage = deadline;
+		}
+		if (reengage)
+			scheduler.schedule(depulse_tick, *reengage);
+		// After a depulse, the next control tick comes one sleeptime after re-engaging the fan,
+		// just like it did when the depulse was a blocking sleep.
+		if (!is_control_tick && (reengaged || (unlikely(did_something) && !pollfds.empty())))
+			scheduler.schedule(control_tick, next_control_tick(now));
+
 		did_something = false;
 	}
+
+	// The sensors may go away before we run again
+	event_loop->set_sources({});
+	running_config = nullptr;
+}
+
+
+/// @brief Parse the argument @a arg of option -@a opt as floating-point seconds.
+static milliseconds parse_sleeptime(const string &arg, char opt, float max = 15)
+{
+	try {
+		size_t invalid;
+		float s = std::stof(arg, &invalid);
+		if (invalid < arg.length() || std::isnan(s))
+			throw InvocationError(MSG_OPT_S_INVAL(opt, arg));
+		if (s > max)
+			throw InvocationError(MSG_OPT_S_MAX(s));
+		else if (s < 0)
+			throw InvocationError("Negative sleep time? Seriously?");
+		else if (s < 0.1f)
+			throw InvocationError(MSG_OPT_S_MIN(s));
+		return milliseconds(static_cast<unsigned int>(std::lround(s * 1000)));
+	} catch (std::invalid_argument &) {
+		throw InvocationError(MSG_OPT_S_INVAL(opt, arg));
+	} catch (std::out_of_range &) {
+		throw InvocationError(MSG_OPT_S_INVAL(opt, arg));
+	}
 }
 
 
 int set_options(int argc, char **argv)
 {
-	const char *optstring = "c:s:b:p::hqDznv"
+	const char *optstring = "c:s:m:i:b:p::t:hqDznv"
 #ifdef USE_ATASMART
 			"d";
 #else
@@ -237,29 +513,20 @@ int set_options(int argc, char **argv)
 			daemonize = false;
 			break;
 		case 's':
-			if (optarg) {
-				try {
-					size_t invalid;
-					int s;
-					string arg(optarg);
-					s = int(std::stoul(arg, &invalid));
-					if (invalid < arg.length())
-						throw InvocationError(MSG_OPT_S_INVAL(optarg));
-					if (s > 15)
-						throw InvocationError(MSG_OPT_S_15(s));
-					else if (s < 0)
-						throw InvocationError("Negative sleep time? Seriously?");
-					else if (s < 1)
-						throw InvocationError(MSG_OPT_S_1(s));
-					sleeptime = seconds(static_cast<unsigned int>(s));
-				} catch (std::invalid_argument &) {
-					throw InvocationError(MSG_OPT_S_INVAL(optarg));
-				} catch (std::out_of_range &) {
-					throw InvocationError(MSG_OPT_S_INVAL(optarg));
-				}
-			}
+			if (optarg)
+				sleeptime = parse_sleeptime(optarg, 's');
 			else throw InvocationError(MSG_OPT_S);
 			break;
+		case 'm':
+			if (optarg)
+				min_sleeptime = parse_sleeptime(optarg, 'm');
+			else throw InvocationError(MSG_OPT_M);
+			break;
+		case 'i':
+			if (optarg)
+				max_sleeptime = parse_sleeptime(optarg, 'i', 600);
+			else throw InvocationError(MSG_OPT_I);
+			break;
 		case 'b':
 			if (optarg) {
 				try {
@@ -290,12 +557,29 @@ int set_options(int argc, char **argv)
 			}
 			else depulse = 0.5f;
 			break;
+		case 't':
+			if (optarg) {
+				try {
+					size_t invalid;
+					string arg(optarg);
+					float t = std::stof(arg, &invalid);
+					if (invalid < arg.length() || t <= 0 || t > 60)
+						throw InvocationError(MSG_OPT_T(optarg));
+					read_deadline = secondsf(t);
+				} catch (std::invalid_argument &) {
+					throw InvocationError(MSG_OPT_T(optarg));
+				} catch (std::out_of_range &) {
+					throw InvocationError(MSG_OPT_T(optarg));
+				}
+			}
+			else throw InvocationError(MSG_OPT_T_NOARG);
+			break;
 		default:
 			throw InvocationError(string("Unknown option: -") + static_cast<char>(optopt));
 		}
 	}
 	if (depulse > 0)
-		log(TF_NFY) << MSG_DEPULSE(depulse, sleeptime.count()) << flush;
+		log(TF_NFY) << MSG_DEPULSE(std::chrono::duration<float>(sleeptime).count(), depulse) << flush;
 
 	return 0;
 }
@@ -312,7 +596,6 @@ void noop()
 int main(int argc, char **argv) {
 	using namespace thinkfan;
 
-	struct sigaction handler;
 #if defined(PID_FILE)
 	unique_ptr<PidFileHolder> pid_file;
 #endif
@@ -325,22 +608,26 @@ int main(int argc, char **argv) {
 	std::set_terminate(handle_uncaught);
 #endif
 
-	memset(&handler, 0, sizeof(handler));
-	handler.sa_handler = sig_handler;
+	// All other signals are received through the event_loop. They must be blocked before any
+	// threads are started.
+	try {
+		EventLoop::block_signals();
+		event_loop.reset(new EventLoop(handle_signal));
+	} catch (SystemError &e) {
+		log(TF_ERR) << e.what() << flush;
+		return 1;
+	}
 
-	if (sigaction(SIGHUP, &handler, nullptr)
-	 || sigaction(SIGINT, &handler, nullptr)
-	 || sigaction(SIGTERM, &handler, nullptr)
-	 || sigaction(SIGUSR1, &handler, nullptr)
-	 || sigaction(SIGPWR, &handler, nullptr)
 #if not defined(DISABLE_BUGGER)
-	 || sigaction(SIGSEGV, &handler, nullptr)
-#endif
-	 || sigaction(SIGUSR2, &handler, nullptr)) {
+	struct sigaction handler;
+	memset(&handler, 0, sizeof(handler));
+	handler.sa_handler = segv_handler;
+	if (sigaction(SIGSEGV, &handler, nullptr)) {
 		string msg = strerror(errno);
 		log(TF_ERR) << "sigaction: " << msg;
 		return 1;
 	}
+#endif
 
 #if not defined(DISABLE_EXCEPTION_CATCHING)
 	try {
@@ -388,6 +675,8 @@ int main(int argc, char **argv) {
 			}
 			else {
 				Logger::instance().enable_syslog();
+				// Don't share the epoll set with the parent
+				event_loop.reset(new EventLoop(handle_signal));
 #if defined(PID_FILE)
 				// Own PID file only in the child...
 				pid_file.reset(new PidFileHolder(::getpid()));
@@ -402,27 +691,32 @@ int main(int argc, char **argv) {
 #endif
 
 		// Load the config for real after forking & enabling syslog
-		unique_ptr<const Config> config(Config::read_config(config_files));
+		unique_ptr<Config> config(Config::read_config(config_files));
+		config->init(temp_state);
 
 		do {
-			config->init(temp_state);
 			run(*config);
 
 			if (interrupted == SIGHUP) {
 				log(TF_NFY) << MSG_RELOAD_CONF << flush;
+				unique_ptr<Config> config_new;
 				try {
-					unique_ptr<const Config> config_new(Config::read_config(config_files));
-					config.swap(config_new);
+					config_new.reset(Config::read_config(config_files));
 				} catch(ExpectedError &) {
 					log(TF_ERR) << MSG_CONF_RELOAD_ERR << flush;
 				} catch(std::exception &e) {
 					log(TF_ERR) << "read_config: " << e.what() << flush;
 					log(TF_ERR) << MSG_CONF_RELOAD_ERR << flush;
 				}
+				if (config_new) {
+					// Only what has actually changed is re-initialized
+					config_new->init(temp_state, std::move(config));
+					config = std::move(config_new);
+				}
 				interrupted = 0;
 			}
 			else if (interrupted == SIGUSR2) {
-				config->init_fans();
+				config->init(temp_state);
 				interrupted = 0;
 			}
 		} while (!interrupted);
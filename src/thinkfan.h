@@ -42,6 +42,10 @@
 #define DEFAULT_SENSOR "/proc/acpi/ibm/thermal"
 #endif
 
+#ifndef DEFAULT_THERMAL_PATH
+#define DEFAULT_THERMAL_PATH "/sys/class/thermal"
+#endif
+
 
 // Stolen from the gurus
 #define likely(x)       __builtin_expect((x),1)
@@ -60,6 +64,7 @@ typedef std::ifstream ifstream;
 typedef std::ofstream ofstream;
 typedef std::fstream fstream;
 typedef std::chrono::duration<unsigned int> seconds;
+typedef std::chrono::duration<unsigned int, std::milli> milliseconds;
 typedef std::chrono::duration<double> secondsf;
 
 template<typename T>
@@ -96,6 +101,7 @@ class HwmonSensorDriver;
 class HwmonFanDriver;
 class TpSensorDriver;
 class TpFanDriver;
+class ThermalZoneSensorDriver;
 
 #ifdef USE_NVML
 class NvmlSensorDriver;
@@ -135,7 +141,8 @@ public:
 #endif // defined(PID_FILE)
 
 
-void sleep(thinkfan::seconds duration);
+void sleep(thinkfan::milliseconds duration);
+void sleep_until(std::chrono::steady_clock::time_point until);
 
 void noop();
 
@@ -147,16 +154,14 @@ extern bool daemonize;
 #ifdef USE_ATASMART
 extern bool dnd_disk;
 #endif /* USE_ATASMART */
-extern seconds sleeptime, tmp_sleeptime;
+extern milliseconds sleeptime, tmp_sleeptime, min_sleeptime, max_sleeptime;
 extern float bias_level;
 extern std::atomic<int> interrupted;
 extern vector<string> config_files;
 extern float depulse;
+extern secondsf read_deadline;
 extern std::atomic<unsigned char> tolerate_errors;
 
-extern std::condition_variable sleep_cond;
-extern std::mutex sleep_mutex;
-
 
 
 }
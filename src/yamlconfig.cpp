@@ -7,6 +7,7 @@
 #include <tuple>
 #include <memory>
 #include <unordered_set>
+#include <cmath>
 
 #include "message.h"
 #include "hwmon.h"
@@ -86,6 +87,16 @@ opt<T> decode_opt(const Node &node) {
 }
 
 
+opt<milliseconds> decode_interval(const Node &node) {
+	if (!node)
+		return nullopt;
+	float interval = node.as<float>();
+	if (!(interval >= 0.1f && interval <= 86400))
+		throw YamlError(get_mark_compat(node), "A sensor's " + kw_interval + " must be between 0.1 and 86400 seconds");
+	return milliseconds(static_cast<unsigned int>(std::lround(interval * 1000)));
+}
+
+
 template<>
 bool convert_driver<vector<wtf_ptr<HwmonSensorDriver>>>(
 	const Node &node,
@@ -95,7 +106,8 @@ bool convert_driver<vector<wtf_ptr<HwmonSensorDriver>>>(
 		return false;
 
 	allowed_keywords(node, {
-		kw_hwmon, kw_correction, kw_name, kw_optional, kw_max_errors, kw_indices, kw_model
+		kw_hwmon, kw_correction, kw_name, kw_optional, kw_max_errors, kw_indices, kw_model, kw_interval,
+		kw_alarm
 	});
 
 	string path = node[kw_hwmon].as<string>();
@@ -106,6 +118,8 @@ bool convert_driver<vector<wtf_ptr<HwmonSensorDriver>>>(
 	bool optional = node[kw_optional] ? node[kw_optional].as<bool>() : false;
 	opt<unsigned int> max_errors = decode_opt<unsigned int>(node[kw_max_errors]);
 	opt<vector<unsigned int>> indices = decode_opt<vector<unsigned int>>(node[kw_indices]);
+	opt<milliseconds> interval = decode_interval(node[kw_interval]);
+	bool alarm = node[kw_alarm] ? node[kw_alarm].as<bool>() : false;
 
 	auto hwmon_iface = std::make_shared<HwmonInterface<SensorDriver>>(path, name, model, indices);
 
@@ -137,6 +151,9 @@ bool convert_driver<vector<wtf_ptr<HwmonSensorDriver>>>(
 			correction ? opt<int>(correction.value()[i]) : nullopt,
 			max_errors
 		));
+		if (interval)
+			drv->set_interval(*interval);
+		drv->set_alarm(alarm);
 		sensors.push_back(drv);
 	}
 
@@ -151,7 +168,7 @@ bool convert_driver<wtf_ptr<TpSensorDriver>>(const Node &node, wtf_ptr<TpSensorD
 		return false;
 
 	allowed_keywords(node, {
-		kw_tpacpi, kw_correction, kw_indices, kw_optional, kw_max_errors
+		kw_tpacpi, kw_correction, kw_indices, kw_optional, kw_max_errors, kw_interval
 	});
 
 	opt<vector<int>> correction = decode_opt<vector<int>>(node[kw_correction]);
@@ -172,6 +189,42 @@ bool convert_driver<wtf_ptr<TpSensorDriver>>(const Node &node, wtf_ptr<TpSensorD
 		correction,
 		max_errors
 	));
+	if (opt<milliseconds> interval = decode_interval(node[kw_interval]))
+		sensor->set_interval(*interval);
+
+	return true;
+}
+
+
+template<>
+bool convert_driver<wtf_ptr<ThermalZoneSensorDriver>>(const Node &node, wtf_ptr<ThermalZoneSensorDriver> &sensor)
+{
+	if (!node[kw_thermal])
+		return false;
+
+	allowed_keywords(node, {
+		kw_thermal, kw_correction, kw_optional, kw_max_errors, kw_interval, kw_netlink
+	});
+
+	opt<vector<int>> correction = decode_opt<vector<int>>(node[kw_correction]);
+	bool optional = node[kw_optional] ? node[kw_optional].as<bool>() : false;
+	opt<unsigned int> max_errors = decode_opt<unsigned int>(node[kw_max_errors]);
+
+	if (correction && correction->size() != 1)
+		throw YamlError(
+			get_mark_compat(node[kw_correction]),
+			MSG_CONF_CORRECTION_LEN(node[kw_thermal].as<string>(), correction->size(), 1)
+		);
+
+	sensor = make_wtf<ThermalZoneSensorDriver>(
+		node[kw_thermal].as<string>(),
+		optional,
+		correction ? opt<int>(correction->front()) : nullopt,
+		max_errors
+	);
+	if (opt<milliseconds> interval = decode_interval(node[kw_interval]))
+		sensor->set_interval(*interval);
+	sensor->set_netlink(node[kw_netlink] ? node[kw_netlink].as<bool>() : false);
 
 	return true;
 }
@@ -185,7 +238,7 @@ bool convert_driver<wtf_ptr<NvmlSensorDriver>>(const Node &node, wtf_ptr<NvmlSen
 		return false;
 
 	allowed_keywords(node, {
-		kw_nvidia, kw_correction, kw_optional, kw_max_errors
+		kw_nvidia, kw_correction, kw_optional, kw_max_errors, kw_interval
 	});
 
 	opt<vector<int>> correction = decode_opt<vector<int>>(node[kw_correction]);
@@ -193,6 +246,8 @@ bool convert_driver<wtf_ptr<NvmlSensorDriver>>(const Node &node, wtf_ptr<NvmlSen
 	opt<unsigned int> max_errors = decode_opt<unsigned int>(node[kw_max_errors]);
 
 	sensor = wtf_ptr<NvmlSensorDriver>(new NvmlSensorDriver(node[kw_nvidia].as<string>(), optional, correction, max_errors));
+	if (opt<milliseconds> interval = decode_interval(node[kw_interval]))
+		sensor->set_interval(*interval);
 
 	return true;
 }
@@ -207,7 +262,7 @@ bool convert_driver<wtf_ptr<AtasmartSensorDriver>>(const Node &node, wtf_ptr<Ata
 		return false;
 
 	allowed_keywords(node, {
-		kw_atasmart, kw_correction, kw_optional, kw_max_errors
+		kw_atasmart, kw_correction, kw_optional, kw_max_errors, kw_interval
 	});
 
 	opt<vector<int>> correction = decode_opt<vector<int>>(node[kw_correction]);
@@ -215,6 +270,8 @@ bool convert_driver<wtf_ptr<AtasmartSensorDriver>>(const Node &node, wtf_ptr<Ata
 	opt<unsigned int> max_errors = decode_opt<unsigned int>(node[kw_max_errors]);
 
 	sensor = make_wtf<AtasmartSensorDriver>(node[kw_atasmart].as<string>(), optional, correction, max_errors);
+	if (opt<milliseconds> interval = decode_interval(node[kw_interval]))
+		sensor->set_interval(*interval);
 
 	return true;
 }
@@ -229,7 +286,7 @@ bool convert_driver<wtf_ptr<LMSensorsDriver>>(const Node &node, wtf_ptr<LMSensor
 		return false;
 
 	allowed_keywords(node, {
-		kw_chip, kw_ids, kw_correction, kw_optional, kw_max_errors
+		kw_chip, kw_ids, kw_correction, kw_optional, kw_max_errors, kw_interval
 	});
 
 	if (!node[kw_ids]) {
@@ -251,6 +308,8 @@ bool convert_driver<wtf_ptr<LMSensorsDriver>>(const Node &node, wtf_ptr<LMSensor
 	}
 
 	sensor = make_wtf<LMSensorsDriver>(chip_name, feature_names, optional, correction, max_errors);
+	if (opt<milliseconds> interval = decode_interval(node[kw_interval]))
+		sensor->set_interval(*interval);
 	return true;
 }
 #endif // USE_LM_SENSORS
@@ -281,7 +340,7 @@ bool convert_driver<vector<wtf_ptr<HwmonFanDriver>>>(const Node &node, vector<wt
 		return false;
 
 	allowed_keywords(node, {
-		kw_hwmon, kw_name, kw_indices, kw_optional, kw_max_errors, kw_levels
+		kw_hwmon, kw_name, kw_indices, kw_optional, kw_max_errors, kw_levels, kw_curve, kw_pid
 	});
 
 	string path = node[kw_hwmon].as<string>();
@@ -324,6 +383,10 @@ struct convert<vector<wtf_ptr<SensorDriver>>> {
 				wtf_ptr<TpSensorDriver> tmp = it->as<wtf_ptr<TpSensorDriver>>();
 				sensors.push_back(std::move(tmp));
 			}
+			else if ((*it)[kw_thermal]) {
+				wtf_ptr<ThermalZoneSensorDriver> tmp = it->as<wtf_ptr<ThermalZoneSensorDriver>>();
+				sensors.push_back(std::move(tmp));
+			}
 #ifdef USE_NVML
 			else if ((*it)[kw_nvidia]) {
 				wtf_ptr<NvmlSensorDriver> tmp = it->as<wtf_ptr<NvmlSensorDriver>>();
@@ -387,6 +450,48 @@ void assign_fan_levels(vector<unique_ptr<StepwiseMapping>> &fan_configs, const N
 
 
 
+vector<pair<int, int>> get_curve(const Node &n) {
+	vector<pair<int, int>> rv;
+	if (!n.IsSequence())
+		throw YamlError(get_mark_compat(n), "Curve entries must be a sequence. Forgot the dashes?");
+	for (const Node &point : n) {
+		if (!point.IsSequence() || point.size() != 2)
+			throw YamlError(get_mark_compat(point), "A curve point must have the form [temperature, pwm]");
+		rv.push_back({ point[0].as<int>(), point[1].as<int>() });
+	}
+	return rv;
+}
+
+
+
+PidController get_pid(const Node &n) {
+	if (!n.IsMap())
+		throw YamlError(get_mark_compat(n), "A PID section must be a map with at least a \"" + kw_target + "\" entry");
+
+	allowed_keywords(n, {
+		kw_target, kw_kp, kw_ki, kw_kd, kw_deadband, kw_min_pwm, kw_max_pwm
+	});
+
+	if (!n[kw_target])
+		throw YamlError(get_mark_compat(n), "Missing \"" + kw_target + "\" temperature");
+
+	for (const string &kw : { kw_kp, kw_ki, kw_kd })
+		if (n[kw] && n[kw].as<float>() < 0)
+			throw YamlError(get_mark_compat(n[kw]), "PID gains must not be negative");
+
+	return PidController(
+		n[kw_target].as<int>(),
+		n[kw_kp] ? n[kw_kp].as<float>() : 8,
+		n[kw_ki] ? n[kw_ki].as<float>() : 0.3f,
+		n[kw_kd] ? n[kw_kd].as<float>() : 0,
+		n[kw_min_pwm] ? n[kw_min_pwm].as<int>() : 0,
+		n[kw_max_pwm] ? n[kw_max_pwm].as<int>() : 255,
+		n[kw_deadband] ? n[kw_deadband].as<unsigned int>() : 1
+	);
+}
+
+
+
 template<>
 struct convert<vector<wtf_ptr<FanConfig>>> {
 	static bool decode(const Node &fans_node, vector<wtf_ptr<FanConfig>> &fan_configs)
@@ -429,6 +534,45 @@ struct convert<vector<wtf_ptr<FanConfig>>> {
 					// Jump through ALL the Ubuntu hoops    (.............................................)
 					fan_configs.push_back(wtf_ptr<FanConfig>(new unique_ptr<FanConfig>(std::move(mapping))));
 			}
+
+			const Node curve_node = (*fans_it)[kw_curve];
+			const Node pid_node = (*fans_it)[kw_pid];
+			if (bool(levels_node) + bool(curve_node) + bool(pid_node) > 1)
+				throw YamlError(
+					get_mark_compat(*fans_it),
+					"A fan can have only one of '" + kw_levels + "', '" + kw_curve + "' or '" + kw_pid + "'"
+				);
+
+			if (curve_node) {
+
+				vector<pair<int, int>> points = get_curve(curve_node);
+
+				for (unique_ptr<FanDriver> &fan_drv : fan_drivers) {
+					unique_ptr<FanConfig> mapping;
+					try {
+						mapping = std::make_unique<CurveMapping>(std::move(fan_drv), points);
+					} catch (ConfigError &e) {
+						throw YamlError(get_mark_compat(curve_node), e.what());
+					}
+					fan_configs.push_back(wtf_ptr<FanConfig>(new unique_ptr<FanConfig>(std::move(mapping))));
+				}
+				fan_drivers.clear();
+			}
+
+			if (pid_node) {
+				PidController pid = get_pid(pid_node);
+
+				for (unique_ptr<FanDriver> &fan_drv : fan_drivers) {
+					unique_ptr<FanConfig> mapping;
+					try {
+						mapping = std::make_unique<PidMapping>(std::move(fan_drv), pid);
+					} catch (ConfigError &e) {
+						throw YamlError(get_mark_compat(pid_node), e.what());
+					}
+					fan_configs.push_back(wtf_ptr<FanConfig>(new unique_ptr<FanConfig>(std::move(mapping))));
+				}
+				fan_drivers.clear();
+			}
 		}
 
 		return fan_configs.size() > initial_size;
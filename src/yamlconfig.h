@@ -18,6 +18,8 @@ const string kw_fans("fans");
 const string kw_levels("levels");
 const string kw_tpacpi("tpacpi");
 const string kw_hwmon("hwmon");
+const string kw_thermal("thermal");
+const string kw_netlink("netlink");
 #ifdef USE_NVML
 const string kw_nvidia("nvml");
 #endif
@@ -37,6 +39,17 @@ const string kw_indices("indices");
 const string kw_correction("correction");
 const string kw_optional("optional");
 const string kw_max_errors("max_errors");
+const string kw_interval("interval");
+const string kw_alarm("alarm");
+const string kw_curve("curve");
+const string kw_pid("pid");
+const string kw_target("target");
+const string kw_kp("kp");
+const string kw_ki("ki");
+const string kw_kd("kd");
+const string kw_deadband("deadband");
+const string kw_min_pwm("min_pwm");
+const string kw_max_pwm("max_pwm");
 
 
 template<>
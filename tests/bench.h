@@ -0,0 +1,66 @@
+/********************************************************************
+ * bench.h: Timing helpers for the microbenchmarks
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#ifndef THINKFAN_BENCH_H_
+#define THINKFAN_BENCH_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+
+namespace thinkfan {
+namespace bench {
+
+
+/// @brief Keep the compiler from optimizing away the computation of @a value.
+template<typename T>
+inline void keep(const T &value)
+{ asm volatile("" : : "g"(&value) : "memory"); }
+
+
+/** @return The time per call of @a fn in nanoseconds: The best of @a rounds rounds of @a iterations calls
+ *  each, so that one-off disturbances (page faults, preemption) don't skew the result. */
+template<class FnT>
+double ns_per_call(FnT &&fn, unsigned int iterations, unsigned int rounds = 5)
+{
+	using clock = std::chrono::steady_clock;
+	double best = std::numeric_limits<double>::max();
+	for (unsigned int r = 0; r < rounds; ++r) {
+		const clock::time_point start = clock::now();
+		for (unsigned int i = 0; i < iterations; ++i)
+			fn();
+		const std::chrono::duration<double, std::nano> elapsed = clock::now() - start;
+		best = std::min(best, elapsed.count() / iterations);
+	}
+	return best;
+}
+
+
+inline void report(const char *name, double ns)
+{ std::printf("%-48s %10.1f ns\n", name, ns); }
+
+
+} // namespace bench
+} // namespace thinkfan
+
+
+#endif // THINKFAN_BENCH_H_
@@ -0,0 +1,56 @@
+/********************************************************************
+ * bench_simd.cpp: The limit comparison kernels for 16 to 1024 temperatures
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "bench.h"
+#include "simd.h"
+
+#include <string>
+
+using namespace thinkfan;
+
+
+int main()
+{
+	const vector<simd::Kernels> kernels = simd::supported_kernels();
+
+	for (size_t n : { 16, 32, 64, 128, 256, 512, 1024 }) {
+		// The worst case: All temperatures are below their limit, so every kernel has to look at all of them
+		vector<int> limit(n), temps(n);
+		for (size_t i = 0; i < n; ++i) {
+			limit[i] = 60 + int(i % 20);
+			temps[i] = 40 + int(i % 13);
+		}
+		const LimitArray limits(limit);
+
+		for (const simd::Kernels &k : kernels) {
+			const string name = std::to_string(n) + " temps, " + k.name;
+			bench::report((name + ": any_ge").c_str(), bench::ns_per_call([&] () {
+				bench::keep(k.any_ge(temps.data(), limits.data(), n));
+			}, 1000000));
+			bench::report((name + ": all_lt").c_str(), bench::ns_per_call([&] () {
+				bench::keep(k.all_lt(temps.data(), limits.data(), n));
+			}, 1000000));
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,128 @@
+/********************************************************************
+ * bench_startup.cpp: Where thinkfan spends its time until the first fan update
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+
+#include "bench.h"
+#include "temp_dir.h"
+#include "config.h"
+#include "config_cache.h"
+#include "hwmon.h"
+#include "sensors.h"
+#include "fans.h"
+
+#include <memory>
+
+using namespace thinkfan;
+
+
+static const unsigned int num_devices = 32;
+// Unrelated subdirectories per device that a name-based search has to look through
+static const unsigned int decoys = 4;
+
+
+/// @brief Something like /sys/devices/platform with @a num_devices hwmons, each one named devN.
+static void make_sysfs(test::TempDir &dir)
+{
+	for (unsigned int i = 0; i < num_devices; ++i) {
+		const string dev = "devices/platform/dev" + std::to_string(i);
+		const string hwmon = dev + "/hwmon/hwmon" + std::to_string(i);
+		dir.write(hwmon + "/name", "dev" + std::to_string(i) + "\n");
+		for (unsigned int t = 1; t <= 4; ++t)
+			dir.write(hwmon + "/temp" + std::to_string(t) + "_input", "42000\n");
+		dir.write(hwmon + "/pwm1", "0\n");
+		dir.write(hwmon + "/pwm1_enable", "1\n");
+		for (unsigned int d = 0; d < decoys; ++d)
+			dir.write(dev + "/decoy" + std::to_string(d) + "/uevent", "");
+	}
+}
+
+
+/// @brief The kind of config that makes startup slow: Everything is looked up by name.
+static string make_config(const string &base)
+{
+	string rv = "sensors:\n";
+	for (unsigned int i = 1; i < num_devices; i += 4)
+		rv += "  - hwmon: " + base + "\n    name: dev" + std::to_string(i) + "\n    indices: [1, 2, 3, 4]\n";
+	rv += "fans:\n  - hwmon: " + base + "\n    name: dev0\n    indices: [1]\n";
+	rv += "levels:\n"
+		"  - [0, 0, 50]\n"
+		"  - [64, 45, 55]\n"
+		"  - [96, 52, 60]\n"
+		"  - [128, 57, 65]\n"
+		"  - [160, 62, 70]\n"
+		"  - [200, 67, 75]\n"
+		"  - [255, 72, 32767]\n";
+	return rv;
+}
+
+
+/** @brief The same lookups that Config::init() does for make_config(). Config::init() itself isn't used
+ *  because it would also write the cache file to CACHE_DIR, which may belong to a running thinkfan. */
+static void lookup_all(const string &base)
+{
+	SysfsIndex::instance().clear();
+	for (unsigned int i = 1; i < num_devices; i += 4) {
+		HwmonInterface<SensorDriver> sensor(base, "dev" + std::to_string(i), nullopt, vector<unsigned int> { 1, 2, 3, 4 });
+		bench::keep(sensor.lookup(0));
+	}
+	HwmonInterface<FanDriver> fan(base, string("dev0"), nullopt, vector<unsigned int> { 1 });
+	bench::keep(fan.lookup(0));
+}
+
+
+int main()
+{
+	test::TempDir dir;
+	make_sysfs(dir);
+	const string base = dir.path() + "/devices";
+	const string config_file = dir.write("thinkfan.yaml", make_config(base));
+	const string config_data = make_config(base);
+	const unsigned int iterations = 200;
+
+	const double parse = bench::ns_per_call([&] {
+		std::unique_ptr<Config> config(Config::read_config({ config_file }));
+		bench::keep(config);
+	}, iterations);
+
+	// Switching back and forth between two configs drops all cached lookups each time, just like
+	// starting up with a different config or without a cache file.
+	bool flip = false;
+	const double cold = bench::ns_per_call([&] {
+		ConfigCache::instance().load(config_file, (flip = !flip) ? config_data : config_data + "\n");
+		lookup_all(base);
+	}, iterations);
+
+	ConfigCache::instance().load(config_file, config_data);
+	lookup_all(base);
+	const double cached = bench::ns_per_call([&] {
+		ConfigCache::instance().load(config_file, config_data);
+		lookup_all(base);
+	}, iterations);
+
+	bench::report("read_config() (YAML parse & conversion)", parse);
+	bench::report("hwmon lookups, cold", cold);
+	bench::report("hwmon lookups, cached", cached);
+	bench::report("startup, cold", parse + cold);
+	bench::report("startup, cached lookups", parse + cached);
+
+	return 0;
+}
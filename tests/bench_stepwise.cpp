@@ -0,0 +1,71 @@
+/********************************************************************
+ * bench_stepwise.cpp: StepwiseMapping level changes, binary search vs. walking level by level
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "bench.h"
+#include "stepwise.h"
+
+#include <string>
+
+using namespace thinkfan;
+using namespace thinkfan::test;
+
+
+/// @return ns per set_fanspeed() for swings between @a low and @a high, and for a steady @a low.
+template<class LevelT>
+static void run(const string &name, const vector<Limits> &limits, int low, int high)
+{
+	unique_ptr<StepwiseMapping> mapping = make_mapping<LevelT>(limits);
+	SingleTemp lo, hi;
+	lo.set(low);
+	hi.set(high);
+	mapping->init_fanspeed(lo.ts);
+
+	bool flip = false;
+	bench::report((name + ": full swing").c_str(), bench::ns_per_call([&] () {
+		flip = !flip;
+		bench::keep(mapping->set_fanspeed(flip ? hi.ts : lo.ts));
+	}, 200000));
+
+	mapping->init_fanspeed(lo.ts);
+	bench::report((name + ": no change").c_str(), bench::ns_per_call([&] () {
+		bench::keep(mapping->set_fanspeed(lo.ts));
+	}, 200000));
+}
+
+
+int main()
+{
+	for (unsigned int n : { 4, 8, 16, 32, 64 }) {
+		// Evenly spaced levels with 5°C of hysteresis
+		vector<Limits> limits;
+		for (unsigned int i = 0; i < n; ++i)
+			limits.push_back({
+				i ? 40 + int(i) * 10 - 5 : numeric_limits<int>::min(),
+				i + 1 < n ? 40 + int(i + 1) * 10 : numeric_limits<int>::max()
+			});
+		const int high = 40 + int(n) * 10;
+
+		run<WalkLevel>(std::to_string(n) + " levels, walk", limits, 30, high);
+		run<SimpleLevel>(std::to_string(n) + " levels, search", limits, 30, high);
+	}
+	return 0;
+}
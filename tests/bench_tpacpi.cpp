@@ -0,0 +1,77 @@
+/********************************************************************
+ * bench_tpacpi.cpp: TpSensorDriver reads, compared to the old iostream-based parser
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "bench.h"
+#include "temp_dir.h"
+#include "sensors.h"
+#include "temperature_state.h"
+
+using namespace thinkfan;
+
+
+/// How TpSensorDriver::read_temps_() used to work: Open the file on each read and parse it with iostreams.
+static void read_ifstream(const string &path, size_t skip_bytes, const vector<bool> &in_use, TemperatureState::Ref &ref)
+{
+	std::ifstream f(path);
+	if (!(f.is_open() && f.good()))
+		throw IOerror(path, errno);
+
+	f.seekg(skip_bytes);
+	if (f.fail())
+		throw IOerror(path, errno);
+
+	unsigned int tidx = 0;
+	int tmp;
+	while (!(f.eof() || f.fail())) {
+		f >> tmp;
+		if (f.bad())
+			throw IOerror(path, errno);
+		if (!f.fail() && in_use[tidx++])
+			ref.add_temp(tmp);
+	}
+}
+
+
+int main()
+{
+	test::TempDir dir;
+	const string path = dir.write("thermal", "temperatures:\t45 40 -128 38 0 -128 51 -128\n");
+	const unsigned int iterations = 100000;
+
+	TemperatureState ts_old(8);
+	TemperatureState::Ref ref_old = ts_old.ref(8);
+	const vector<bool> in_use(8, true);
+	bench::report("tpacpi, 8 temps: ifstream + operator >>", bench::ns_per_call([&] () {
+		ref_old.restart();
+		read_ifstream(path, std::char_traits<char>::length("temperatures:"), in_use, ref_old);
+	}, iterations));
+
+	TpSensorDriver drv(path, false);
+	drv.try_init();
+	TemperatureState ts_new(drv.num_temps());
+	drv.init_temp_state_ref(ts_new.ref(drv.num_temps()));
+	bench::report("tpacpi, 8 temps: pread() + parse_int()", bench::ns_per_call([&] () {
+		drv.read_temps();
+	}, iterations));
+
+	return ts_old.temps() == ts_new.temps() ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+/********************************************************************
+ * globals.cpp: The process-wide state that thinkfan.cpp normally defines,
+ * for tests and benchmarks that link against thinkfan_core
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "thinkfan.h"
+
+#include <thread>
+
+namespace thinkfan {
+
+
+bool chk_sanity(true);
+bool quiet(false);
+bool daemonize(false);
+milliseconds sleeptime(5000);
+milliseconds tmp_sleeptime = sleeptime;
+milliseconds min_sleeptime(2000);
+milliseconds max_sleeptime(0);
+float bias_level(0);
+float depulse = 0;
+secondsf read_deadline(1);
+std::atomic<unsigned char> tolerate_errors(0);
+std::atomic<int> interrupted(0);
+vector<string> config_files;
+
+#ifdef USE_ATASMART
+bool dnd_disk = false;
+#endif
+
+
+void PidFileHolder::cleanup()
+{}
+
+
+void sleep(thinkfan::milliseconds duration)
+{ std::this_thread::sleep_for(duration); }
+
+
+void sleep_until(std::chrono::steady_clock::time_point until)
+{ std::this_thread::sleep_until(until); }
+
+
+void noop()
+{}
+
+
+} // namespace thinkfan
@@ -0,0 +1,92 @@
+/********************************************************************
+ * nvml_stub.cpp: A fake libnvidia-ml.so.1 with two GPUs that counts calls
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "nvml_stub.h"
+
+#include <nvidia/gdk/nvml.h>
+#include <cstring>
+
+static NvmlStubState state;
+static const char *const bus_ids[NVML_STUB_NUM_DEVICES] = { NVML_STUB_BUS_ID_0, NVML_STUB_BUS_ID_1 };
+
+// Device handles are just pointers to the device index
+static int device_idx[NVML_STUB_NUM_DEVICES] = { 0, 1 };
+
+static int index_of(nvmlDevice_t dev)
+{ return *reinterpret_cast<int *>(dev); }
+
+
+extern "C" {
+
+NvmlStubState *nvml_stub_state()
+{ return &state; }
+
+
+nvmlReturn_t nvmlInit_v2()
+{
+	++state.init_calls;
+	return NVML_SUCCESS;
+}
+
+
+nvmlReturn_t nvmlShutdown()
+{
+	if (state.shutdown_calls >= state.init_calls)
+		return NVML_ERROR_UNINITIALIZED;
+	++state.shutdown_calls;
+	return NVML_SUCCESS;
+}
+
+
+nvmlReturn_t nvmlDeviceGetHandleByPciBusId_v2(const char *bus_id, nvmlDevice_t *device)
+{
+	if (state.shutdown_calls >= state.init_calls)
+		return NVML_ERROR_UNINITIALIZED;
+	for (int i = 0; i < NVML_STUB_NUM_DEVICES; ++i) {
+		if (!std::strcmp(bus_id, bus_ids[i])) {
+			*device = reinterpret_cast<nvmlDevice_t>(&device_idx[i]);
+			return NVML_SUCCESS;
+		}
+	}
+	return NVML_ERROR_NOT_FOUND;
+}
+
+
+nvmlReturn_t nvmlDeviceGetName(nvmlDevice_t device, char *name, unsigned int length)
+{
+	const char *names[NVML_STUB_NUM_DEVICES] = { "Stub GPU 0", "Stub GPU 1" };
+	std::strncpy(name, names[index_of(device)], length);
+	return NVML_SUCCESS;
+}
+
+
+nvmlReturn_t nvmlDeviceGetTemperature(nvmlDevice_t device, nvmlTemperatureSensors_t, unsigned int *temp)
+{
+	++state.temperature_calls;
+	const int i = index_of(device);
+	if (state.err[i])
+		return nvmlReturn_t(state.err[i]);
+	*temp = state.temp[i];
+	return NVML_SUCCESS;
+}
+
+}
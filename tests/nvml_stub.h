@@ -0,0 +1,41 @@
+/********************************************************************
+ * nvml_stub.h: Control interface of the fake libnvidia-ml.so.1 used by test_nvml
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#ifndef THINKFAN_NVML_STUB_H_
+#define THINKFAN_NVML_STUB_H_
+
+#define NVML_STUB_NUM_DEVICES 2
+
+/// @brief Call counters and device state. Get it with dlsym(handle, "nvml_stub_state").
+struct NvmlStubState {
+	int init_calls;
+	int shutdown_calls;
+	int temperature_calls;
+	unsigned int temp[NVML_STUB_NUM_DEVICES];
+	int err[NVML_STUB_NUM_DEVICES];
+};
+
+/// The PCI bus IDs of the fake GPUs, in device order
+#define NVML_STUB_BUS_ID_0 "00000000:01:00.0"
+#define NVML_STUB_BUS_ID_1 "00000000:02:00.0"
+
+#endif // THINKFAN_NVML_STUB_H_
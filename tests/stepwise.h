@@ -0,0 +1,141 @@
+/********************************************************************
+ * stepwise.h: Helpers for testing and benchmarking StepwiseMapping
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#ifndef THINKFAN_TEST_STEPWISE_H_
+#define THINKFAN_TEST_STEPWISE_H_
+
+#include "config.h"
+#include "fans.h"
+#include "temperature_state.h"
+
+#include <random>
+
+namespace thinkfan {
+namespace test {
+
+
+/// @brief A fan that only remembers which level it was set to.
+class RecordingFanDriver : public FanDriver {
+public:
+	RecordingFanDriver()
+	: FanDriver(false)
+	{}
+
+	virtual void set_speed(const Level &level) override
+	{ level_ = level.num(); }
+
+	int level() const
+	{ return level_; }
+
+protected:
+	virtual void init() override {}
+	virtual string lookup() override { return "recording"; }
+	virtual string type_name() const override { return "recording fan driver"; }
+	virtual string source() const override { return "recording"; }
+
+private:
+	int level_ = -1;
+};
+
+
+/** @brief Behaves exactly like a SimpleLevel, but isn't one. So a StepwiseMapping that consists of
+ *  these always walks the levels one by one, which is how it used to work. */
+class WalkLevel : public Level {
+public:
+	WalkLevel(int level, int lower_limit, int upper_limit)
+	: Level(level, lower_limit, upper_limit)
+	{}
+
+	virtual bool up(const TemperatureState &ts) const override
+	{ return *ts.tmax >= upper_limit().front(); }
+
+	virtual bool down(const TemperatureState &ts) const override
+	{ return *ts.tmax < lower_limit().front(); }
+
+	virtual void ensure_consistency(const Config &) const override
+	{}
+};
+
+
+/// @brief The limits of one level
+struct Limits {
+	int lower;
+	int upper;
+};
+
+
+/** @brief Random levels with overlapping limits, like in a typical config: Both limits never
+ *  decrease from one level to the next, and neighbouring limits may be equal. */
+inline vector<Limits> random_levels(std::mt19937 &rng, unsigned int n)
+{
+	std::uniform_int_distribution<int> step(0, 4), hysteresis(1, 8);
+	const int h = hysteresis(rng);
+	vector<Limits> rv;
+	int upper = 35;
+	for (unsigned int i = 0; i < n; ++i) {
+		const int lower = i ? rv.back().upper - h : numeric_limits<int>::min();
+		upper += step(rng) + (i ? 0 : 4);
+		rv.push_back({ lower, i + 1 < n ? upper : numeric_limits<int>::max() });
+	}
+	return rv;
+}
+
+
+/// @brief A StepwiseMapping of @a LevelT with the given @a limits that drives a @a RecordingFanDriver.
+template<class LevelT>
+unique_ptr<StepwiseMapping> make_mapping(const vector<Limits> &limits)
+{
+	auto rv = std::make_unique<StepwiseMapping>(std::make_unique<RecordingFanDriver>());
+	for (size_t i = 0; i < limits.size(); ++i)
+		rv->add_level(std::make_unique<LevelT>(int(i), limits[i].lower, limits[i].upper));
+	return rv;
+}
+
+
+inline int fan_level(const StepwiseMapping &mapping)
+{ return static_cast<const RecordingFanDriver &>(*mapping.fan()).level(); }
+
+
+/// @brief A single temperature that can be set directly
+struct SingleTemp {
+	SingleTemp()
+	: ts(1)
+	, ref(ts.ref(1))
+	{}
+
+	void set(int t)
+	{
+		ref.restart();
+		ref.add_temp(t);
+		ts.update_tmax();
+	}
+
+	TemperatureState ts;
+	TemperatureState::Ref ref;
+};
+
+
+} // namespace test
+} // namespace thinkfan
+
+
+#endif // THINKFAN_TEST_STEPWISE_H_
@@ -0,0 +1,86 @@
+/********************************************************************
+ * temp_dir.h: Scratch directories for mock sysfs trees and the like
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#ifndef THINKFAN_TEMP_DIR_H_
+#define THINKFAN_TEMP_DIR_H_
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <ftw.h>
+#include <sys/stat.h>
+
+namespace thinkfan {
+namespace test {
+
+
+/// @brief A unique, empty temporary directory that's removed (recursively) when this goes out of scope.
+class TempDir {
+public:
+	TempDir();
+	~TempDir();
+	const std::string &path() const { return path_; }
+
+	/// @brief Create (or overwrite) the file @a name in this directory, creating parent directories as needed.
+	std::string write(const std::string &name, const std::string &content) const;
+
+private:
+	std::string path_;
+};
+
+
+inline TempDir::TempDir()
+{
+	const char *tmp = std::getenv("TMPDIR");
+	std::string tmpl = std::string(tmp ? tmp : "/tmp") + "/thinkfan-test.XXXXXX";
+	if (!::mkdtemp(tmpl.data()))
+		throw std::runtime_error("mkdtemp: " + std::string(std::strerror(errno)));
+	path_ = tmpl;
+}
+
+inline TempDir::~TempDir()
+{
+	::nftw(path_.c_str(), [] (const char *p, const struct stat *, int, struct FTW *) {
+		return ::remove(p);
+	}, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+inline std::string TempDir::write(const std::string &name, const std::string &content) const
+{
+	std::string dir = path_;
+	for (size_t pos = name.find('/'); pos != std::string::npos; pos = name.find('/', pos + 1)) {
+		dir = path_ + "/" + name.substr(0, pos);
+		::mkdir(dir.c_str(), 0755);
+	}
+	const std::string file = path_ + "/" + name;
+	std::ofstream(file, std::ios::trunc) << content;
+	return file;
+}
+
+
+} // namespace test
+} // namespace thinkfan
+
+
+#endif // THINKFAN_TEMP_DIR_H_
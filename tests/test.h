@@ -0,0 +1,91 @@
+/********************************************************************
+ * test.h: A minimal unit test harness, so the tests don't need any
+ * dependencies besides the ones thinkfan already has.
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#ifndef THINKFAN_TEST_H_
+#define THINKFAN_TEST_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "temp_dir.h"
+
+namespace thinkfan {
+namespace test {
+
+
+struct Case {
+	const char *name;
+	void (*fn)();
+};
+
+std::vector<Case> &cases();
+
+/// @brief Counts failed checks in the current test case.
+extern unsigned int failures;
+
+struct Register {
+	Register(const char *name, void (*fn)())
+	{ cases().push_back({ name, fn }); }
+};
+
+
+} // namespace test
+} // namespace thinkfan
+
+
+#define TEST(name) \
+	static void test_##name(); \
+	static ::thinkfan::test::Register register_##name(#name, test_##name); \
+	static void test_##name()
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed" << std::endl; \
+			++::thinkfan::test::failures; \
+		} \
+	} while (0)
+
+#define CHECK_EQ(a, b) \
+	do { \
+		const auto &va_ = (a); \
+		const auto &vb_ = (b); \
+		if (!(va_ == vb_)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #a ", " #b ") failed: " \
+				<< va_ << " != " << vb_ << std::endl; \
+			++::thinkfan::test::failures; \
+		} \
+	} while (0)
+
+#define CHECK_THROWS(ExcT, expr) \
+	do { \
+		bool caught_ = false; \
+		try { expr; } catch (const ExcT &) { caught_ = true; } \
+		if (!caught_) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": " #expr " didn't throw " #ExcT << std::endl; \
+			++::thinkfan::test::failures; \
+		} \
+	} while (0)
+
+
+#endif // THINKFAN_TEST_H_
@@ -0,0 +1,208 @@
+/********************************************************************
+ * test_config.cpp: Driver initialization for a whole config
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "test.h"
+#include "config.h"
+#include "fans.h"
+#include "hwmon.h"
+#include "sensors.h"
+
+#include <fstream>
+#include <memory>
+
+using namespace thinkfan;
+
+
+static string first_line(const string &path)
+{
+	std::ifstream f(path);
+	string rv;
+	std::getline(f, rv);
+	return rv;
+}
+
+
+struct HwmonConfig {
+	HwmonConfig()
+	{
+		sensor = dir.write("hwmon0/temp1_input", "42000\n");
+		pwm = dir.write("hwmon0/pwm1", "0\n");
+		enable = dir.write("hwmon0/pwm1_enable", "2\n");
+		config.reset(Config::read_config({ dir.write("thinkfan.yaml",
+			"sensors:\n  - hwmon: " + sensor + "\n"
+			"fans:\n  - hwmon: " + pwm + "\n"
+			"levels:\n  - [0, 0, 50]\n  - [255, 45, 32767]\n"
+		) }));
+	}
+
+	test::TempDir dir;
+	string sensor, pwm, enable;
+	std::unique_ptr<Config> config;
+};
+
+
+TEST(init_drivers)
+{
+	HwmonConfig h;
+	h.config->init_drivers();
+	CHECK(h.config->sensors().front()->initialized());
+	CHECK(h.config->fan_configs().front()->fan()->initialized());
+}
+
+
+TEST(reinit_only_uninitialized)
+{
+	HwmonConfig h;
+	h.config->init_drivers();
+
+	// Firmware took the fan back, but on a SIGHUP reload, drivers that are already set up stay as they are
+	{ std::ofstream(h.enable) << "2\n"; }
+	h.config->init_drivers();
+	CHECK_EQ(first_line(h.enable), "2");
+}
+
+
+TEST(reinit_forced)
+{
+	HwmonConfig h;
+	h.config->init_drivers();
+
+	// Like after a resume: The fan needs to be put under manual control again
+	{ std::ofstream(h.enable) << "2\n"; }
+	h.config->init_drivers(true);
+	CHECK_EQ(first_line(h.enable), "1");
+}
+
+
+/// @brief One hwmon entry with three temperatures, the last of which gets @a correction.
+static unique_ptr<Config> shared_hwmon_config(test::TempDir &dir, int correction)
+{
+	return unique_ptr<Config>(Config::read_config({ dir.write("thinkfan.yaml",
+		"sensors:\n"
+		"  - hwmon: " + dir.path() + "/hwmon0\n"
+		"    indices: [1, 2, 3]\n"
+		"    correction: [0, 0, " + std::to_string(correction) + "]\n"
+		"fans:\n  - hwmon: " + dir.path() + "/hwmon0/pwm1\n"
+		"levels:\n  - [0, 0, 50]\n  - [255, 45, 32767]\n"
+	) }));
+}
+
+
+TEST(reload_partially_changed_hwmon)
+{
+	test::TempDir dir;
+	for (const char *f : { "temp1_input", "temp2_input", "temp3_input", "pwm1" })
+		dir.write(string("hwmon0/") + f, "0\n");
+	dir.write("hwmon0/pwm1_enable", "2\n");
+
+	TemperatureState ts(0);
+	unique_ptr<Config> prev = shared_hwmon_config(dir, 0);
+	prev->init(ts);
+
+	// Only the last temperature changes, so the first two drivers are kept and the third one must
+	// find its own file through a new HwmonInterface.
+	// NB: Like any reload, this updates the cache in CACHE_DIR if it's writable.
+	unique_ptr<Config> config = shared_hwmon_config(dir, 5);
+	config->init(ts, std::move(prev));
+
+	CHECK_EQ(config->sensors().size(), 3u);
+	for (unsigned int i = 0; i < config->sensors().size(); ++i) {
+		CHECK(config->sensors()[i]->initialized());
+		CHECK_EQ(config->sensors()[i]->path(), dir.path() + "/hwmon0/temp" + std::to_string(i + 1) + "_input");
+	}
+}
+
+
+TEST(hwmon_lookup_by_client)
+{
+	test::TempDir dir;
+	for (const char *f : { "pwm1", "pwm2", "pwm3" })
+		dir.write(string("hwmon0/") + f, "0\n");
+
+	HwmonInterface<FanDriver> hwmon(dir.path() + "/hwmon0", nullopt, nullopt, vector<unsigned int> { 1, 2, 3 });
+	for (unsigned int i = 0; i < 3; ++i)
+		CHECK_EQ(hwmon.add_client(), i);
+
+	// In any order, e.g. when only the last fan is new after a reload
+	CHECK_EQ(hwmon.lookup(2), dir.path() + "/hwmon0/pwm3");
+	CHECK_EQ(hwmon.lookup(0), dir.path() + "/hwmon0/pwm1");
+	CHECK_EQ(hwmon.lookup(2), dir.path() + "/hwmon0/pwm3");
+	CHECK_THROWS(Bug, hwmon.lookup(3));
+}
+
+
+/// @brief A config with one sensor and one fan, either of which may be missing from @a dir.
+static unique_ptr<Config> late_device_config(test::TempDir &dir, unsigned int max_errors)
+{
+	return unique_ptr<Config>(Config::read_config({ dir.write("thinkfan.yaml",
+		"sensors:\n"
+		"  - hwmon: " + dir.path() + "/hwmon0/temp1_input\n"
+		"    max_errors: " + std::to_string(max_errors) + "\n"
+		"fans:\n"
+		"  - hwmon: " + dir.path() + "/hwmon1/pwm1\n"
+		"    max_errors: " + std::to_string(max_errors) + "\n"
+		"levels:\n  - [0, 0, 50]\n  - [255, 45, 32767]\n"
+	) }));
+}
+
+
+TEST(fans_dont_wait_for_fans)
+{
+	test::TempDir dir;
+	dir.write("hwmon0/temp1_input", "42000\n");
+	unique_ptr<Config> config = late_device_config(dir, 100);
+
+	// With all temperatures known, the missing fan is retried while running
+	const auto start = std::chrono::steady_clock::now();
+	config->init_drivers();
+	CHECK(std::chrono::steady_clock::now() - start < sleeptime);
+	CHECK(config->sensors().front()->initialized());
+	CHECK(!config->fan_configs().front()->fan()->initialized());
+}
+
+
+TEST(missing_sensor_deadline)
+{
+	test::TempDir dir;
+	const string pwm = dir.write("hwmon1/pwm1", "0\n");
+	dir.write("hwmon1/pwm1_enable", "2\n");
+	const milliseconds prev_sleeptime = sleeptime;
+	sleeptime = milliseconds(10);
+
+	// Fans that are ready run at full speed until the deadline...
+	chk_sanity = false;
+	unique_ptr<Config> config = late_device_config(dir, 3);
+	const auto start = std::chrono::steady_clock::now();
+	config->init_drivers();
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	CHECK(elapsed >= 2 * sleeptime && elapsed < 100 * sleeptime);
+	CHECK(!config->sensors().front()->initialized());
+	CHECK(config->fan_configs().front()->fan()->initialized());
+	CHECK_EQ(first_line(pwm), "255");
+
+	// ... and then it's an error, unless errors are tolerated
+	chk_sanity = true;
+	config = late_device_config(dir, 3);
+	CHECK_THROWS(ExpectedError, config->init_drivers());
+
+	sleeptime = prev_sleeptime;
+}
@@ -0,0 +1,142 @@
+/********************************************************************
+ * test_driver.cpp: Error handling of drivers whose device is missing
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "test.h"
+#include "sensors.h"
+#include "fans.h"
+#include "config.h"
+#include "temperature_state.h"
+
+#include <cerrno>
+
+using namespace thinkfan;
+
+
+/// @brief A sensor whose device never shows up.
+class MissingSensorDriver : public SensorDriver {
+public:
+	MissingSensorDriver(bool optional, unsigned int max_errors)
+	: SensorDriver(optional, nullopt, max_errors)
+	{ set_num_temps(1); }
+
+	unsigned int lookups = 0;
+
+protected:
+	virtual void read_temps_() override
+	{ temp_state_.add_temp(42); }
+
+	virtual string lookup() override
+	{
+		++lookups;
+		throw IOerror("missing sensor", ENOENT);
+	}
+
+	virtual string type_name() const override
+	{ return "missing sensor driver"; }
+
+	virtual string source() const override
+	{ return "missing"; }
+};
+
+
+/// @brief A fan whose device never shows up.
+class MissingFanDriver : public FanDriver {
+public:
+	MissingFanDriver(bool optional, unsigned int max_errors)
+	: FanDriver(optional, 0, max_errors)
+	{}
+
+	virtual void set_speed(const Level &level) override
+	{ write(level.str()); }
+
+	void write(const string &level)
+	{ FanDriver::set_speed(level); }
+
+	unsigned int lookups = 0;
+
+protected:
+	virtual void init() override {}
+
+	virtual string lookup() override
+	{
+		++lookups;
+		throw IOerror("missing fan", ENOENT);
+	}
+
+	virtual string type_name() const override
+	{ return "missing fan driver"; }
+
+	virtual string source() const override
+	{ return "missing"; }
+};
+
+
+TEST(optional_sensor_backs_off)
+{
+	TemperatureState ts(1);
+	MissingSensorDriver sensor(true, 0);
+	sensor.init_temp_state_ref(ts.ref(1));
+
+	sensor.read_temps();
+	CHECK_EQ(sensor.lookups, 1u);
+
+	// Not looked for again until its backoff has passed...
+	for (int i = 0; i < 10; ++i)
+		sensor.read_temps();
+	CHECK_EQ(sensor.lookups, 1u);
+
+	// ... or something was hotplugged
+	sensor.reset_backoff();
+	sensor.read_temps();
+	CHECK_EQ(sensor.lookups, 2u);
+}
+
+
+TEST(sensor_counts_errors)
+{
+	TemperatureState ts(1);
+	MissingSensorDriver sensor(false, 3);
+	sensor.init_temp_state_ref(ts.ref(1));
+
+	sensor.read_temps();
+	sensor.read_temps();
+	CHECK_EQ(sensor.lookups, 2u);
+	CHECK_EQ(sensor.errors(), 2u);
+	CHECK_THROWS(ExpectedError, sensor.read_temps());
+}
+
+
+TEST(fan_counts_errors)
+{
+	// Even an optional fan must not go unattended for the length of a backoff
+	MissingFanDriver optional(true, 0);
+	for (int i = 0; i < 3; ++i)
+		optional.write("level 1");
+	CHECK_EQ(optional.lookups, 3u);
+
+	MissingFanDriver fan(false, 3);
+	fan.write("level 1");
+	fan.write("level 2");
+	CHECK_EQ(fan.lookups, 2u);
+	CHECK_EQ(fan.errors(), 2u);
+	CHECK_THROWS(ExpectedError, fan.write("level 3"));
+}
@@ -0,0 +1,68 @@
+/********************************************************************
+ * test_fans.cpp: Fan driver helpers that don't need any hardware
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "test.h"
+#include "fans.h"
+
+using namespace thinkfan;
+
+
+class ProbeTpFan : public TpFanDriver {
+public:
+	ProbeTpFan() : TpFanDriver("/proc/acpi/ibm/fan") {}
+	using TpFanDriver::should_spin;
+
+	bool should_spin_at(const string &level)
+	{
+		current_speed_ = level;
+		return should_spin();
+	}
+};
+
+
+TEST(tpacpi_should_spin)
+{
+	ProbeTpFan fan;
+	CHECK(!fan.should_spin_at("level 0"));
+	// The EC decides in auto mode, so a stopped fan isn't a stall
+	CHECK(!fan.should_spin_at("level auto"));
+	CHECK(fan.should_spin_at("level 1"));
+	CHECK(fan.should_spin_at("level 7"));
+	CHECK(fan.should_spin_at("level full-speed"));
+	CHECK(fan.should_spin_at("level disengaged"));
+}
+
+
+TEST(pwm_string)
+{
+	CHECK_EQ(HwmonFanDriver::pwm_string(0), "0");
+	CHECK_EQ(HwmonFanDriver::pwm_string(128), "128");
+	CHECK_EQ(HwmonFanDriver::pwm_string(255), "255");
+
+	// Out-of-range values must not share storage
+	const string a = HwmonFanDriver::pwm_string(256);
+	const string &b = HwmonFanDriver::pwm_string(-1);
+	CHECK_EQ(a, "256");
+	CHECK_EQ(b, "-1");
+	CHECK_EQ(HwmonFanDriver::pwm_string(1000), "1000");
+	CHECK_EQ(b, "-1");
+}
@@ -0,0 +1,168 @@
+/********************************************************************
+ * test_hwmon_alarm.cpp: hwmon temperature alarms against a mock sysfs tree
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "test.h"
+#include "sensors.h"
+#include "event_loop.h"
+#include "temperature_state.h"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace thinkfan;
+using test::TempDir;
+
+
+static string contents(const string &path)
+{
+	std::ifstream f(path);
+	std::stringstream ss;
+	ss << f.rdbuf();
+	return ss.str();
+}
+
+
+/// @brief A hwmon with one temperature that has both a max and a min alarm
+struct MockHwmon {
+	MockHwmon()
+	: input(dir.write("hwmon0/temp1_input", "45000\n"))
+	, max(dir.write("hwmon0/temp1_max", "80000\n"))
+	, min(dir.write("hwmon0/temp1_min", "10000\n"))
+	, ts(1)
+	{
+		dir.write("hwmon0/name", "mock\n");
+		dir.write("hwmon0/temp1_max_alarm", "0\n");
+		dir.write("hwmon0/temp1_min_alarm", "0\n");
+	}
+
+	TempDir dir;
+	const string input, max, min;
+	TemperatureState ts;
+};
+
+
+TEST(alarm_window)
+{
+	MockHwmon hwmon;
+	{
+		HwmonSensorDriver drv(hwmon.input, false);
+		drv.set_alarm(true);
+		drv.try_init();
+		CHECK(drv.initialized());
+		drv.init_temp_state_ref(hwmon.ts.ref(1));
+		drv.read_temps();
+		CHECK_EQ(hwmon.ts.temps()[0], 45);
+
+		// The max alarm goes off above the limit, so it's set 1 °C below the upper limit
+		const int lower = 40, upper = 50;
+		CHECK(drv.set_alarm_window(&lower, &upper));
+		CHECK_EQ(std::stoi(contents(hwmon.max)), 49000);
+		CHECK_EQ(std::stoi(contents(hwmon.min)), 40000);
+
+		vector<pollfd> fds;
+		drv.alarm_fds(fds);
+		CHECK_EQ(fds.size(), 2u);
+		for (const pollfd &p : fds)
+			CHECK_EQ(p.events, POLLPRI);
+
+		// Regular files can't be waited for, so the main loop has to poll them
+		EventLoop loop([] (int) {});
+		CHECK(!loop.set_sources(fds));
+
+		// No limit in either direction restores the original values
+		const int no_lower = numeric_limits<int>::min(), no_upper = numeric_limits<int>::max();
+		CHECK(drv.set_alarm_window(&no_lower, &no_upper));
+		CHECK_EQ(std::stoi(contents(hwmon.max)), 80000);
+		CHECK_EQ(std::stoi(contents(hwmon.min)), 10000);
+
+		CHECK(drv.set_alarm_window(&lower, &upper));
+	}
+	// And so does destroying the driver
+	CHECK_EQ(std::stoi(contents(hwmon.max)), 80000);
+	CHECK_EQ(std::stoi(contents(hwmon.min)), 10000);
+}
+
+
+TEST(alarm_wakeup)
+{
+	MockHwmon hwmon;
+	HwmonSensorDriver drv(hwmon.input, false);
+	drv.set_alarm(true);
+	drv.try_init();
+	drv.init_temp_state_ref(hwmon.ts.ref(1));
+	drv.read_temps();
+
+	const int lower = 40, upper = 50;
+	CHECK(drv.set_alarm_window(&lower, &upper));
+	vector<pollfd> fds;
+	drv.alarm_fds(fds);
+	CHECK(!fds.empty());
+
+	// sysfs signals an alarm with POLLPRI, which a mock file can't do. So the max alarm's fd is
+	// replaced by a pipe, and the "chip" signals the alarm by writing to the pipe instead.
+	int pipe_fds[2];
+	CHECK_EQ(::pipe(pipe_fds), 0);
+	const int alarm_fd = fds[0].fd;
+	CHECK(::dup2(pipe_fds[0], alarm_fd) == alarm_fd);
+	::close(pipe_fds[0]);
+
+	EventLoop loop([] (int) {});
+	loop.add_watch(alarm_fd);
+
+	std::thread chip([&] () {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		hwmon.dir.write("hwmon0/temp1_input", "52000\n");
+		CHECK_EQ(::write(pipe_fds[1], "1", 1), 1);
+	});
+
+	vector<int> ready;
+	const auto start = EventLoop::clock::now();
+	const bool woken = loop.wait_until(start + std::chrono::seconds(5), ready);
+	chip.join();
+
+	CHECK(woken);
+	CHECK(EventLoop::clock::now() - start < std::chrono::seconds(5));
+	CHECK_EQ(ready.size(), 1u);
+	CHECK(ready.size() == 1 && ready[0] == alarm_fd);
+
+	// The driver owns the fd that went off, and the main loop reads the temperatures again
+	CHECK(!drv.ack_alarm(pipe_fds[1]));
+	CHECK(drv.ack_alarm(alarm_fd));
+	drv.read_temps();
+	CHECK_EQ(hwmon.ts.temps()[0], 52);
+
+	char c;
+	CHECK_EQ(::read(alarm_fd, &c, 1), 1);
+	::close(pipe_fds[1]);
+}
+
+
+TEST(no_alarm_attributes)
+{
+	TempDir dir;
+	const string input = dir.write("hwmon0/temp1_input", "45000\n");
+	HwmonSensorDriver drv(input, false);
+	drv.set_alarm(true);
+	CHECK_THROWS(ConfigError, drv.try_init());
+}
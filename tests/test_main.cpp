@@ -0,0 +1,67 @@
+/********************************************************************
+ * test_main.cpp: Runs all test cases linked into a test executable
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "test.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+
+namespace thinkfan {
+namespace test {
+
+
+unsigned int failures = 0;
+
+std::vector<Case> &cases()
+{
+	static std::vector<Case> cases;
+	return cases;
+}
+
+
+} // namespace test
+} // namespace thinkfan
+
+
+int main(int argc, char **argv)
+{
+	using namespace thinkfan::test;
+
+	unsigned int failed_cases = 0;
+	for (const Case &c : cases()) {
+		if (argc > 1 && std::strcmp(argv[1], c.name))
+			continue;
+
+		failures = 0;
+		try {
+			c.fn();
+		} catch (std::exception &e) {
+			std::cerr << c.name << ": Unexpected exception: " << e.what() << std::endl;
+			++failures;
+		}
+		std::cout << (failures ? "FAIL " : "ok   ") << c.name << std::endl;
+		if (failures)
+			++failed_cases;
+	}
+
+	return failed_cases ? EXIT_FAILURE : EXIT_SUCCESS;
+}
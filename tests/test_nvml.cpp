@@ -0,0 +1,145 @@
+/********************************************************************
+ * test_nvml.cpp: NvmlInterface against a fake libnvidia-ml.so.1 (cf. nvml_stub.cpp)
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "test.h"
+#include "nvml.h"
+#include "nvml_stub.h"
+#include "error.h"
+
+#include <dlfcn.h>
+#include <thread>
+
+using namespace thinkfan;
+
+
+/// @brief Keeps the stub loaded between the tests, so its counters survive NvmlInterface's dlclose().
+static NvmlStubState &stub()
+{
+	static void *handle = dlopen("libnvidia-ml.so.1", RTLD_NOW);
+	if (!handle)
+		throw std::runtime_error(string("Failed to load NVML stub: ") + dlerror());
+	static NvmlStubState *(*state_fn)() = reinterpret_cast<NvmlStubState *(*)()>(dlsym(handle, "nvml_stub_state"));
+	if (!state_fn)
+		throw std::runtime_error("libnvidia-ml.so.1 is not the NVML stub");
+	return *state_fn();
+}
+
+static void reset_stub()
+{ stub() = NvmlStubState { 0, 0, 0, { 40, 50 }, { 0, 0 } }; }
+
+
+TEST(single_pass)
+{
+	reset_stub();
+	shared_ptr<NvmlInterface> nvml = NvmlInterface::instance();
+	CHECK_EQ(nvml->lookup_device(NVML_STUB_BUS_ID_0), string("Stub GPU 0"));
+	CHECK_EQ(nvml->lookup_device(NVML_STUB_BUS_ID_1), string("Stub GPU 1"));
+	CHECK_EQ(stub().temperature_calls, 0);
+
+	// The first read goes through all GPUs, the second one picks up its temperature from the same pass
+	CHECK_EQ(nvml->get_temp(NVML_STUB_BUS_ID_0), 40u);
+	CHECK_EQ(stub().temperature_calls, 2);
+	CHECK_EQ(nvml->get_temp(NVML_STUB_BUS_ID_1), 50u);
+	CHECK_EQ(stub().temperature_calls, 2);
+
+	// Each result is used only once, so the next loop makes a new pass
+	stub().temp[0] = 41;
+	stub().temp[1] = 51;
+	CHECK_EQ(nvml->get_temp(NVML_STUB_BUS_ID_1), 51u);
+	CHECK_EQ(stub().temperature_calls, 4);
+	CHECK_EQ(nvml->get_temp(NVML_STUB_BUS_ID_0), 41u);
+	CHECK_EQ(stub().temperature_calls, 4);
+}
+
+
+TEST(stale_pass)
+{
+	reset_stub();
+	const secondsf old_deadline = read_deadline;
+	read_deadline = secondsf(0.01);
+
+	shared_ptr<NvmlInterface> nvml = NvmlInterface::instance();
+	nvml->lookup_device(NVML_STUB_BUS_ID_0);
+	nvml->lookup_device(NVML_STUB_BUS_ID_1);
+	nvml->get_temp(NVML_STUB_BUS_ID_0);
+	CHECK_EQ(stub().temperature_calls, 2);
+
+	// A result that's older than the read deadline is from a previous loop, so it's read again
+	std::this_thread::sleep_for(std::chrono::milliseconds(30));
+	stub().temp[1] = 52;
+	CHECK_EQ(nvml->get_temp(NVML_STUB_BUS_ID_1), 52u);
+	CHECK_EQ(stub().temperature_calls, 4);
+
+	read_deadline = old_deadline;
+}
+
+
+TEST(errors)
+{
+	reset_stub();
+	shared_ptr<NvmlInterface> nvml = NvmlInterface::instance();
+	CHECK_THROWS(SystemError, nvml->lookup_device("00000000:03:00.0"));
+	nvml->lookup_device(NVML_STUB_BUS_ID_0);
+	nvml->lookup_device(NVML_STUB_BUS_ID_1);
+
+	// A lost GPU fails only its own read
+	stub().err[0] = NVML_ERROR_GPU_IS_LOST;
+	CHECK_THROWS(SystemError, nvml->get_temp(NVML_STUB_BUS_ID_0));
+	CHECK_EQ(nvml->get_temp(NVML_STUB_BUS_ID_1), 50u);
+	CHECK_EQ(stub().temperature_calls, 2);
+}
+
+
+TEST(refcounted_shutdown)
+{
+	reset_stub();
+	shared_ptr<NvmlInterface> a = NvmlInterface::instance();
+	shared_ptr<NvmlInterface> b = NvmlInterface::instance();
+	CHECK(a == b);
+
+	a->lookup_device(NVML_STUB_BUS_ID_0);
+	b->lookup_device(NVML_STUB_BUS_ID_1);
+	CHECK_EQ(stub().init_calls, 1);
+
+	a.reset();
+	CHECK_EQ(stub().shutdown_calls, 0);
+	CHECK_EQ(b->get_temp(NVML_STUB_BUS_ID_1), 50u);
+
+	b.reset();
+	CHECK_EQ(stub().shutdown_calls, 1);
+
+	// The next user gets a fresh instance that initializes NVML again
+	shared_ptr<NvmlInterface> c = NvmlInterface::instance();
+	c->lookup_device(NVML_STUB_BUS_ID_0);
+	CHECK_EQ(stub().init_calls, 2);
+	c.reset();
+	CHECK_EQ(stub().shutdown_calls, 2);
+}
+
+
+TEST(no_shutdown_without_init)
+{
+	reset_stub();
+	NvmlInterface::instance().reset();
+	CHECK_EQ(stub().init_calls, 0);
+	CHECK_EQ(stub().shutdown_calls, 0);
+}
@@ -0,0 +1,238 @@
+/********************************************************************
+ * test_pid.cpp: PidController against a simulated thermal plant
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "test.h"
+#include "pid.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace thinkfan;
+
+
+/** @brief A lumped thermal model of a CPU with a fan-cooled heatsink: @a power heats a thermal mass
+ *  of @a capacity J/K that's cooled towards @a ambient with a conductance that grows with the PWM value.
+ *  With the defaults, the full fan holds it at 47°C and it settles at 113°C without any cooling. */
+struct Plant {
+	double temp = 35;
+	double ambient = 30;
+	double capacity = 40;
+	double power = 25;
+
+	double conductance(int pwm) const
+	{ return 0.3 + 1.2 * pwm / 255.0; }
+
+	void advance(int pwm, unsigned int dt_ms)
+	{
+		// Small Euler steps, the time constant is tens of seconds
+		for (unsigned int t = 0; t < dt_ms; t += 10)
+			temp += (power - (temp - ambient) * conductance(pwm)) / capacity * 0.01;
+	}
+
+	/// @brief Sensors report whole degrees
+	int reading() const
+	{ return int(std::lround(temp)); }
+};
+
+
+/// @brief Runs the closed loop with thinkfan's default 5s sleeptime and records what happens.
+struct Loop {
+	Loop(const PidController &pid)
+	: pid(pid)
+	{
+		this->pid.reset(this->pid.out_min());
+		pwm = this->pid.step(plant.reading(), 0);
+	}
+
+	void run(unsigned int seconds)
+	{
+		pwm_changes = 0;
+		max_temp = min_temp = plant.temp;
+		for (unsigned int t = 0; t < seconds * 1000; t += dt_ms) {
+			plant.advance(pwm, dt_ms);
+			const int next = pid.step(plant.reading(), dt_ms);
+			CHECK(next >= pid.out_min() && next <= pid.out_max());
+			pwm_changes += next != pwm;
+			pwm = next;
+			max_temp = std::max(max_temp, plant.temp);
+			min_temp = std::min(min_temp, plant.temp);
+		}
+	}
+
+	PidController pid;
+	Plant plant;
+	unsigned int dt_ms = 5000;
+	int pwm;
+	unsigned int pwm_changes;
+	double max_temp, min_temp;
+};
+
+
+static PidController default_pid(int target = 60)
+{ return PidController(target, 8, 0.3f, 0, 0, 255, 1); }
+
+
+TEST(settles_at_target)
+{
+	Loop loop(default_pid());
+	loop.run(1200);
+
+	// After 20 minutes, it holds the target within the deadband...
+	loop.run(600);
+	CHECK(loop.max_temp < 61.5);
+	CHECK(loop.min_temp > 58.5);
+	// ...and has stopped writing to the fan. 113 is the PWM value that holds 60°C.
+	CHECK_EQ(loop.pwm_changes, 0u);
+	CHECK(std::abs(loop.pwm - 113) <= 8);
+}
+
+
+TEST(load_step)
+{
+	Loop loop(default_pid());
+	loop.run(1200);
+
+	// Sudden load increase: 40 W need a PWM value of about 212 at 60°C
+	loop.plant.power = 40;
+	loop.run(120);
+	CHECK(loop.max_temp < 68);
+	loop.run(600);
+	loop.run(300);
+	CHECK(loop.max_temp < 61.5);
+	CHECK(loop.min_temp > 58.5);
+	CHECK(std::abs(loop.pwm - 212) <= 8);
+
+	// And back down
+	loop.plant.power = 25;
+	loop.run(900);
+	loop.run(300);
+	CHECK(loop.max_temp < 61.5);
+	CHECK(loop.min_temp > 58.5);
+}
+
+
+TEST(anti_windup)
+{
+	Loop loop(default_pid());
+
+	// More heat than the fan can handle: Even at full speed, this settles at 70°C
+	loop.plant.power = 60;
+	loop.run(1800);
+	CHECK_EQ(loop.pwm, 255);
+	CHECK(loop.plant.temp > 65);
+
+	// Once the load is gone, the fan must slow down as soon as the temperature is back at the target.
+	// A wound-up integral term would keep it at full speed for a long time after that.
+	loop.plant.power = 10;
+	unsigned int seconds = 0;
+	while (loop.plant.reading() > 60 && seconds < 600) {
+		loop.run(5);
+		seconds += 5;
+	}
+	CHECK(seconds < 600);
+	CHECK(loop.pwm < 230);
+
+	// Same thing without the plant: The integral term only holds what's needed on top of the P term
+	PidController pid = default_pid();
+	pid.reset(0);
+	int out = 0;
+	for (int i = 0; i < 100; ++i)
+		out = pid.step(75, 5000);
+	CHECK_EQ(out, 255);
+	CHECK(pid.step(60, 5000) <= 255 - 8 * 15 + 8);
+}
+
+
+TEST(deadband)
+{
+	PidController pid(60, 8, 0.3f, 0, 0, 255, 2);
+	pid.reset(100);
+	const int out = pid.step(60, 0);
+	for (int temp : { 61, 62, 58, 59, 60, 62, 58 })
+		CHECK_EQ(pid.step(temp, 5000), out);
+	CHECK(pid.step(63, 5000) > out);
+}
+
+
+TEST(output_range)
+{
+	PidController pid(60, 8, 0.3f, 2, 40, 200, 1);
+	pid.reset(0);
+	CHECK_EQ(pid.step(20, 0), 40);
+	for (int i = 0; i < 100; ++i)
+		CHECK_EQ(pid.step(120, 5000), 200);
+	for (int i = 0; i < 100; ++i)
+		CHECK_EQ(pid.step(20, 5000), 40);
+}
+
+
+TEST(derivative_on_temperature)
+{
+	// A rising temperature gives more output with a D term than without
+	PidController p(60, 8, 0, 0, 0, 255, 0);
+	PidController pd(60, 8, 0, 20, 0, 255, 0);
+	p.reset(0);
+	pd.reset(0);
+	p.step(60, 0);
+	pd.step(60, 0);
+	CHECK_EQ(p.step(65, 1000), 40);
+	CHECK_EQ(pd.step(65, 1000), 140);
+	// A steady temperature doesn't
+	CHECK_EQ(pd.step(65, 1000), 40);
+}
+
+
+TEST(matches_floating_point)
+{
+	// The fixed-point math gives the same result as a straightforward floating-point PID
+	const double kp = 8, ki = 0.3, kd = 1.5;
+	PidController pid(60, float(kp), float(ki), float(kd), 0, 255, 1);
+	pid.reset(0);
+
+	double integral = 0;
+	int prev = 0;
+	bool have_prev = false;
+	unsigned int seed = 1;
+	int temp = 55;
+	for (int i = 0; i < 5000; ++i) {
+		seed = seed * 1103515245 + 12345;
+		temp = std::clamp(temp + int((seed >> 16) % 5) - 2, 40, 80);
+		const unsigned int dt = 500 + (seed >> 8) % 4500;
+
+		const double err = std::abs(temp - 60) <= 1 ? 0 : temp - 60;
+		const double derivative = have_prev ? kd * (temp - prev) * 1000 / dt : 0;
+		prev = temp;
+		have_prev = true;
+		const double next_integral = std::clamp(integral + ki * err * dt / 1000, 0.0, 255.0);
+		const double out = kp * err + next_integral + derivative;
+		if (!((out > 255 && err > 0) || (out < 0 && err < 0)))
+			integral = next_integral;
+
+		const int expected = int(std::lround(std::clamp(out, 0.0, 255.0)));
+		const int actual = pid.step(temp, dt);
+		if (std::abs(actual - expected) > 1) {
+			std::cerr << "Step " << i << ": " << actual << " != " << expected << std::endl;
+			++test::failures;
+			break;
+		}
+	}
+}
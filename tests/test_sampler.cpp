@@ -0,0 +1,115 @@
+/********************************************************************
+ * test_sampler.cpp: Reading blocking sensors on worker threads
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "test.h"
+#include "sampler.h"
+#include "sensors.h"
+#include "temperature_state.h"
+
+#include <thread>
+
+using namespace thinkfan;
+
+
+/// @brief A blocking sensor that takes @a delay to fetch a single temperature.
+class SlowSensorDriver : public SensorDriver {
+public:
+	SlowSensorDriver(std::chrono::milliseconds delay, bool optional, unsigned int max_errors)
+	: SensorDriver(optional, nullopt, max_errors)
+	, delay_(delay)
+	{ set_num_temps(1); }
+
+	virtual bool blocking() const override
+	{ return true; }
+
+protected:
+	virtual void init() override
+	{}
+
+	virtual void read_temps_() override
+	{ temp_state_.add_temp(42); }
+
+	virtual void fetch_temps_() override
+	{
+		std::this_thread::sleep_for(delay_);
+		fetched_temps_ = { 42 };
+	}
+
+	virtual string lookup() override
+	{ return "slow"; }
+
+	virtual string type_name() const override
+	{ return "slow sensor driver"; }
+
+	virtual string source() const override
+	{ return "slow"; }
+
+private:
+	const std::chrono::milliseconds delay_;
+};
+
+
+struct SamplerFixture {
+	SamplerFixture(bool optional, unsigned int max_errors)
+	: ts(1)
+	{
+		read_deadline = secondsf(0.02);
+		sensors.push_back(std::make_unique<SlowSensorDriver>(std::chrono::milliseconds(300), optional, max_errors));
+		sensors[0]->init_temp_state_ref(ts.ref(1));
+	}
+
+	~SamplerFixture()
+	{ read_deadline = secondsf(1); }
+
+	TemperatureState ts;
+	vector<unique_ptr<SensorDriver>> sensors;
+};
+
+
+TEST(late_reads_count_as_errors)
+{
+	SamplerFixture f(false, 2);
+	SensorSampler sampler(f.sensors);
+
+	// The first read initializes the driver synchronously
+	sampler.read_temps();
+	CHECK_EQ(f.sensors[0]->errors(), 0u);
+	CHECK_EQ(f.ts.temps()[0], 42);
+
+	// Then it's fetched on a worker that misses the deadline
+	sampler.read_temps();
+	CHECK_EQ(f.sensors[0]->errors(), 1u);
+	CHECK_EQ(f.ts.temps()[0], 42);
+
+	CHECK_THROWS(ExpectedError, sampler.read_temps());
+}
+
+
+TEST(late_reads_of_optional_sensors)
+{
+	SamplerFixture f(true, 0);
+	SensorSampler sampler(f.sensors);
+
+	for (int i = 0; i < 4; ++i)
+		sampler.read_temps();
+	CHECK_EQ(f.ts.temps()[0], -128);
+}
@@ -0,0 +1,166 @@
+/********************************************************************
+ * test_scheduler.cpp: Main loop deadlines and the adaptive sleeptime
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "test.h"
+#include "scheduler.h"
+#include "error.h"
+
+using namespace thinkfan;
+
+using clock_t_ = Scheduler::clock;
+static const clock_t_::time_point t0 = clock_t_::now();
+
+static clock_t_::time_point at(int ms)
+{ return t0 + milliseconds(ms); }
+
+
+TEST(sleeptime_curve)
+{
+	// With -s 5 -m 0.25, as documented in thinkfan(1)
+	const milliseconds floor(250), ceiling(5000);
+	milliseconds t = adapt_sleeptime(ceiling, true, true, floor, ceiling);
+	CHECK_EQ(t.count(), 250u);
+
+	vector<unsigned int> curve { t.count() };
+	while (t < ceiling) {
+		t = adapt_sleeptime(t, false, true, floor, ceiling);
+		curve.push_back(t.count());
+	}
+	const vector<unsigned int> expected { 250, 375, 562, 843, 1264, 1896, 2844, 4266, 5000 };
+	CHECK(curve == expected);
+
+	// Stays there
+	CHECK_EQ(adapt_sleeptime(t, false, true, floor, ceiling).count(), 5000u);
+}
+
+
+TEST(fast_rise)
+{
+	const milliseconds floor(250), ceiling(5000);
+
+	// Drops to the floor right away, from anywhere on the curve, with or without a control tick
+	for (unsigned int ms : { 5000, 4266, 843, 375 }) {
+		CHECK_EQ(adapt_sleeptime(milliseconds(ms), true, true, floor, ceiling).count(), 250u);
+		CHECK_EQ(adapt_sleeptime(milliseconds(ms), true, false, floor, ceiling).count(), 250u);
+	}
+
+	// But never goes up because of it
+	CHECK_EQ(adapt_sleeptime(milliseconds(100), true, true, floor, ceiling).count(), 100u);
+}
+
+
+TEST(growth_only_on_control_ticks)
+{
+	const milliseconds floor(250), ceiling(5000);
+
+	// Wakeups for sensors with their own interval don't lengthen the period
+	CHECK_EQ(adapt_sleeptime(milliseconds(375), false, false, floor, ceiling).count(), 375u);
+
+	// A lower ceiling (e.g. after leaving idle) applies right away
+	CHECK_EQ(adapt_sleeptime(milliseconds(20000), false, false, floor, ceiling).count(), 5000u);
+	CHECK_EQ(adapt_sleeptime(milliseconds(20000), false, true, floor, ceiling).count(), 5000u);
+
+	// Even tiny periods grow
+	CHECK_EQ(adapt_sleeptime(milliseconds(1), false, true, floor, ceiling).count(), 2u);
+}
+
+
+TEST(deadline_order)
+{
+	Scheduler s;
+	vector<Scheduler::Entry> due;
+	s.schedule(0, at(300));
+	s.schedule(1, at(100));
+	s.schedule(2, at(200));
+	CHECK(s.next() == at(100));
+
+	s.pop_due(at(250), due);
+	CHECK_EQ(due.size(), 2u);
+	CHECK(due.size() == 2 && due[0].id == 1 && due[1].id == 2);
+	CHECK(s.next() == at(300));
+
+	s.pop_due(at(300), due);
+	CHECK(due.size() == 1 && due[0].id == 0);
+	CHECK(s.empty());
+	CHECK_THROWS(Bug, s.next());
+}
+
+
+TEST(schedule_replaces)
+{
+	Scheduler s;
+	vector<Scheduler::Entry> due;
+	s.schedule(0, at(100));
+	s.schedule(0, at(500));
+	CHECK(s.next() == at(500));
+	s.pop_due(at(400), due);
+	CHECK(due.empty());
+	s.pop_due(at(500), due);
+	CHECK_EQ(due.size(), 1u);
+	CHECK(s.empty());
+}
+
+
+TEST(advance_never_postpones)
+{
+	Scheduler s;
+	vector<Scheduler::Entry> due;
+
+	s.schedule(0, at(1000));
+	s.advance(0, at(2000));
+	CHECK(s.next() == at(1000));
+	s.advance(0, at(1000));
+	CHECK(s.next() == at(1000));
+
+	s.advance(0, at(400));
+	CHECK(s.next() == at(400));
+	s.pop_due(at(400), due);
+	CHECK(due.size() == 1 && due[0].id == 0);
+	// The old deadline is gone with it
+	CHECK(s.empty());
+
+	// Once it's been popped, it's not scheduled anymore, so advance() schedules it
+	s.advance(0, at(5000));
+	CHECK(s.next() == at(5000));
+
+	// Same for an id that has never been scheduled
+	s.advance(7, at(3000));
+	CHECK(s.next() == at(3000));
+}
+
+
+TEST(reschedule)
+{
+	Scheduler s;
+	vector<Scheduler::Entry> due;
+	s.schedule(0, at(100));
+	s.pop_due(at(150), due);
+
+	// Periodic deadlines don't drift with the wakeup latency
+	s.reschedule(due[0], at(150), milliseconds(100));
+	CHECK(s.next() == at(200));
+
+	// After a suspend, missed periods are skipped instead of firing all at once
+	s.pop_due(at(10000), due);
+	s.reschedule(due[0], at(10000), milliseconds(100));
+	CHECK(s.next() == at(10100));
+}
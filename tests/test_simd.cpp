@@ -0,0 +1,129 @@
+/********************************************************************
+ * test_simd.cpp: All limit comparison kernels agree with the scalar one
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "test.h"
+#include "simd.h"
+
+#include <random>
+
+using namespace thinkfan;
+
+
+static bool any_ge_reference(const vector<int> &temps, size_t offset, const vector<int> &limit)
+{
+	for (size_t i = 0; i < limit.size(); ++i)
+		if (temps[offset + i] >= limit[i])
+			return true;
+	return false;
+}
+
+
+TEST(kernels_available)
+{
+	const vector<simd::Kernels> kernels = simd::supported_kernels();
+	CHECK(!kernels.empty());
+	CHECK_EQ(string(kernels.back().name), string("scalar"));
+	for (const simd::Kernels &k : kernels)
+		std::cout << "Testing " << k.name << " kernels" << std::endl;
+}
+
+
+TEST(kernels_agree)
+{
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<int> temp(-128, 127);
+	const vector<simd::Kernels> kernels = simd::supported_kernels();
+
+	// All lengths around the vector widths, plus some large ones
+	vector<size_t> sizes;
+	for (size_t n = 0; n <= 40; ++n)
+		sizes.push_back(n);
+	for (size_t n : { 63, 64, 65, 255, 1023, 1024 })
+		sizes.push_back(n);
+
+	for (size_t n : sizes) {
+		for (int round = 0; round < 50; ++round) {
+			vector<int> limit(n);
+			for (int &l : limit)
+				l = temp(rng);
+			const LimitArray limits(limit);
+
+			// temps don't have to be aligned
+			const size_t offset = size_t(round % 8);
+			vector<int> temps(n + offset);
+			for (size_t i = 0; i < n; ++i) {
+				// Mostly just below the limit, sometimes exactly on it or above, to hit every lane
+				switch (rng() % 8) {
+				case 0: temps[offset + i] = limit[i]; break;
+				case 1: temps[offset + i] = limit[i] + 1; break;
+				default: temps[offset + i] = limit[i] - 1 - int(rng() % 10);
+				}
+			}
+			// Also make sure to cover the case where everything is below the limits
+			if (round % 5 == 0)
+				for (size_t i = 0; i < n; ++i)
+					temps[offset + i] = limit[i] - 1;
+
+			const bool expected = any_ge_reference(temps, offset, limit);
+			for (const simd::Kernels &k : kernels) {
+				const bool any_ge = k.any_ge(temps.data() + offset, limits.data(), n);
+				const bool all_lt = k.all_lt(temps.data() + offset, limits.data(), n);
+				if (any_ge != expected || all_lt == expected) {
+					std::cerr << k.name << ": wrong result with n = " << n << ", round " << round << std::endl;
+					++test::failures;
+				}
+			}
+		}
+	}
+}
+
+
+TEST(single_hit)
+{
+	// Exactly one temperature reaches its limit, at every position
+	const size_t n = 67;
+	const LimitArray limits(vector<int>(n, 60));
+	for (const simd::Kernels &k : simd::supported_kernels()) {
+		for (size_t hit = 0; hit < n; ++hit) {
+			vector<int> temps(n, 59);
+			temps[hit] = 60;
+			CHECK(k.any_ge(temps.data(), limits.data(), n));
+			CHECK(!k.all_lt(temps.data(), limits.data(), n));
+		}
+		vector<int> temps(n, 59);
+		CHECK(!k.any_ge(temps.data(), limits.data(), n));
+		CHECK(k.all_lt(temps.data(), limits.data(), n));
+	}
+}
+
+
+TEST(extreme_values)
+{
+	const vector<int> limit(9, numeric_limits<int>::min());
+	const LimitArray limits(limit);
+	const vector<int> temps(9, numeric_limits<int>::min());
+	const LimitArray max_limits(vector<int>(9, numeric_limits<int>::max()));
+	for (const simd::Kernels &k : simd::supported_kernels()) {
+		CHECK(k.any_ge(temps.data(), limits.data(), 9));
+		CHECK(k.all_lt(temps.data(), max_limits.data(), 9));
+	}
+}
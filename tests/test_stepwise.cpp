@@ -0,0 +1,136 @@
+/********************************************************************
+ * test_stepwise.cpp: The binary search in StepwiseMapping gives the same levels as the walk
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "test.h"
+#include "stepwise.h"
+
+using namespace thinkfan;
+using namespace thinkfan::test;
+
+
+TEST(hysteresis)
+{
+	// Level 0 up to 50°C, level 1 from 45°C to 60°C, level 2 from 55°C
+	const vector<Limits> limits {
+		{ numeric_limits<int>::min(), 50 },
+		{ 45, 60 },
+		{ 55, numeric_limits<int>::max() }
+	};
+
+	vector<unique_ptr<StepwiseMapping>> mappings;
+	mappings.push_back(make_mapping<SimpleLevel>(limits));
+	mappings.push_back(make_mapping<WalkLevel>(limits));
+	for (auto &mapping : mappings) {
+		SingleTemp t;
+		t.set(40);
+		mapping->init_fanspeed(t.ts);
+		CHECK_EQ(fan_level(*mapping), 0);
+
+		t.set(49);
+		CHECK(!mapping->set_fanspeed(t.ts));
+		t.set(50);
+		CHECK(mapping->set_fanspeed(t.ts));
+		CHECK_EQ(fan_level(*mapping), 1);
+
+		// Stays on level 1 until its lower limit is undercut
+		t.set(45);
+		CHECK(!mapping->set_fanspeed(t.ts));
+		t.set(44);
+		CHECK(mapping->set_fanspeed(t.ts));
+		CHECK_EQ(fan_level(*mapping), 0);
+
+		// Jumps over level 1 in one go
+		t.set(70);
+		CHECK(mapping->set_fanspeed(t.ts));
+		CHECK_EQ(fan_level(*mapping), 2);
+		t.set(55);
+		CHECK(!mapping->set_fanspeed(t.ts));
+		t.set(20);
+		CHECK(mapping->set_fanspeed(t.ts));
+		CHECK_EQ(fan_level(*mapping), 0);
+
+		// Starting hot picks the highest level
+		t.set(58);
+		mapping->init_fanspeed(t.ts);
+		CHECK_EQ(fan_level(*mapping), 2);
+	}
+}
+
+
+TEST(search_equals_walk)
+{
+	std::mt19937 rng(4711);
+	std::uniform_int_distribution<int> jump(-15, 15), start(20, 90);
+
+	for (unsigned int config = 0; config < 2000; ++config) {
+		const vector<Limits> limits = random_levels(rng, 1 + rng() % 64);
+		unique_ptr<StepwiseMapping> search = make_mapping<SimpleLevel>(limits);
+		unique_ptr<StepwiseMapping> walk = make_mapping<WalkLevel>(limits);
+
+		SingleTemp t;
+		int temp = start(rng);
+		t.set(temp);
+		search->init_fanspeed(t.ts);
+		walk->init_fanspeed(t.ts);
+		CHECK_EQ(fan_level(*search), fan_level(*walk));
+
+		for (int step = 0; step < 300; ++step) {
+			// Mostly small changes around the limits, sometimes big jumps
+			temp = std::clamp(temp + (step % 10 ? jump(rng) / 5 : jump(rng) * 4), -20, 150);
+			t.set(temp);
+			const bool search_changed = search->set_fanspeed(t.ts);
+			const bool walk_changed = walk->set_fanspeed(t.ts);
+			if (search_changed != walk_changed || fan_level(*search) != fan_level(*walk)) {
+				std::cerr << "Config " << config << ", step " << step << ", " << temp << "°C: search is on level "
+					<< fan_level(*search) << ", walk on level " << fan_level(*walk) << std::endl;
+				++failures;
+				break;
+			}
+		}
+	}
+}
+
+
+TEST(non_monotonic_limits)
+{
+	// Level 1's upper limit is above level 2's, so the search can't be used. The walk stops on level 1
+	// at 62°C, even though level 2's upper limit is lower.
+	const vector<Limits> limits {
+		{ numeric_limits<int>::min(), 50 },
+		{ 45, 65 },
+		{ 55, 60 },
+		{ 58, numeric_limits<int>::max() }
+	};
+	unique_ptr<StepwiseMapping> search = make_mapping<SimpleLevel>(limits);
+	unique_ptr<StepwiseMapping> walk = make_mapping<WalkLevel>(limits);
+
+	SingleTemp t;
+	t.set(40);
+	search->init_fanspeed(t.ts);
+	walk->init_fanspeed(t.ts);
+	for (int temp : { 62, 66, 57, 54, 61, 40, 70 }) {
+		t.set(temp);
+		search->set_fanspeed(t.ts);
+		walk->set_fanspeed(t.ts);
+		CHECK_EQ(fan_level(*search), fan_level(*walk));
+	}
+}
@@ -0,0 +1,90 @@
+/********************************************************************
+ * test_temperature_state.cpp: Temperatures, biases, history and tmax
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "test.h"
+#include "temperature_state.h"
+
+using namespace thinkfan;
+
+
+TEST(tmax_follows_partial_reads)
+{
+	TemperatureState ts(3);
+	TemperatureState::Ref a = ts.ref(1);
+	TemperatureState::Ref b = ts.ref(2);
+
+	a.add_temp(60);
+	b.add_temp(50);
+	b.add_temp(55);
+	ts.update_tmax();
+	CHECK_EQ(*ts.tmax, 60);
+
+	// Only a is due this time, and it has cooled down below b's temperatures
+	a.restart();
+	a.add_temp(40);
+	ts.update_tmax();
+	CHECK_EQ(*ts.tmax, 55);
+
+	// Only b is due
+	b.restart();
+	b.add_temp(50);
+	b.add_temp(45);
+	ts.update_tmax();
+	CHECK_EQ(*ts.tmax, 50);
+}
+
+
+TEST(tmax_includes_bias)
+{
+	const float old_bias_level = bias_level;
+	bias_level = 1.5;
+
+	TemperatureState ts(2);
+	TemperatureState::Ref a = ts.ref(1);
+	TemperatureState::Ref b = ts.ref(1);
+	a.add_temp(50);
+	b.add_temp(52);
+	// A rise by 4 °C gets a bias of 6
+	a.restart();
+	a.add_temp(54);
+	ts.update_tmax();
+	CHECK_EQ(*ts.tmax, 60);
+	CHECK(ts.take_fast_rise());
+
+	bias_level = old_bias_level;
+}
+
+
+TEST(history)
+{
+	TemperatureState ts(1);
+	TemperatureState::Ref a = ts.ref(1);
+	for (int t = 0; t < 20; ++t) {
+		a.restart();
+		a.add_temp(40 + t);
+	}
+	CHECK_EQ(ts.history_depth(0), TemperatureState::history_size);
+	CHECK_EQ(ts.history(0, 0), 59);
+	CHECK_EQ(ts.history(0, TemperatureState::history_size - 1), 44);
+	CHECK(ts.steady(1, 0));
+	CHECK(!ts.steady(2, 0));
+}
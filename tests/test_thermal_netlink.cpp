@@ -0,0 +1,207 @@
+/********************************************************************
+ * test_thermal_netlink.cpp: Parsing thermal genetlink events
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "test.h"
+#include "thermal_netlink.h"
+
+#include <cstring>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/thermal.h>
+
+using namespace thinkfan;
+
+#ifdef THERMAL_GENL_FAMILY_NAME
+
+static const uint16_t family = 0x1a;
+static const std::multiset<int> zones { 1, 3 };
+
+
+/// @brief Builds a buffer of netlink messages like the ones a recv() on the event socket returns.
+class Messages {
+public:
+	/// @brief Start a new netlink message without a payload.
+	Messages &bare(uint16_t type = family)
+	{
+		start_ = buf_.size();
+		struct nlmsghdr nlh;
+		std::memset(&nlh, 0, sizeof(nlh));
+		nlh.nlmsg_type = type;
+		append(&nlh, sizeof(nlh));
+		return set_len();
+	}
+
+	/// @brief Start a new genetlink message with command @a cmd.
+	Messages &msg(uint8_t cmd, uint16_t type = family)
+	{
+		bare(type);
+		struct genlmsghdr genl;
+		std::memset(&genl, 0, sizeof(genl));
+		genl.cmd = cmd;
+		append(&genl, sizeof(genl));
+		return set_len();
+	}
+
+	Messages &attr(uint16_t type, uint32_t value, uint16_t nla_len = NLA_HDRLEN + sizeof(uint32_t))
+	{
+		struct nlattr nla;
+		nla.nla_len = nla_len;
+		nla.nla_type = type;
+		append(&nla, sizeof(nla));
+		append(&value, sizeof(value));
+		return set_len();
+	}
+
+	Messages &trip(uint8_t cmd, uint32_t zone_id, uint16_t type = family)
+	{ return msg(cmd, type).attr(THERMAL_GENL_ATTR_TZ_ID, zone_id).attr(THERMAL_GENL_ATTR_TZ_TRIP_ID, 0); }
+
+	/// @brief Overwrite the nlmsg_len of the current message.
+	Messages &nlmsg_len(uint32_t len)
+	{
+		reinterpret_cast<struct nlmsghdr *>(&buf_[start_])->nlmsg_len = len;
+		return *this;
+	}
+
+	bool parse(size_t len) const
+	{
+		// recv() buffers are aligned, NLMSG_DATA() etc. rely on that
+		vector<uint32_t> aligned(buf_.size() / sizeof(uint32_t) + 1);
+		std::memcpy(aligned.data(), buf_.data(), buf_.size());
+		return ThermalNetlink::parse_events(reinterpret_cast<const char *>(aligned.data()), len, family, zones);
+	}
+
+	bool parse() const
+	{ return parse(buf_.size()); }
+
+	size_t size() const
+	{ return buf_.size(); }
+
+private:
+	void append(const void *data, size_t len)
+	{
+		buf_.append(static_cast<const char *>(data), len);
+		buf_.resize(NLMSG_ALIGN(buf_.size()), '\0');
+	}
+
+	Messages &set_len()
+	{ return nlmsg_len(uint32_t(buf_.size() - start_)); }
+
+	string buf_;
+	size_t start_ = 0;
+};
+
+
+TEST(trip_points)
+{
+	CHECK(Messages().trip(THERMAL_GENL_EVENT_TZ_TRIP_UP, 1).parse());
+	CHECK(Messages().trip(THERMAL_GENL_EVENT_TZ_TRIP_DOWN, 3).parse());
+	// Flag bits in the attribute type are ignored
+	CHECK(Messages().msg(THERMAL_GENL_EVENT_TZ_TRIP_UP).attr(THERMAL_GENL_ATTR_TZ_ID | NLA_F_NET_BYTEORDER, 3).parse());
+}
+
+
+TEST(ignored_events)
+{
+	CHECK(!Messages().parse());
+	CHECK(!Messages().trip(THERMAL_GENL_EVENT_TZ_TRIP_UP, 2).parse());
+	CHECK(!Messages().trip(THERMAL_GENL_EVENT_TZ_TRIP_UP, 1, family + 1).parse());
+	CHECK(!Messages().trip(THERMAL_GENL_EVENT_TZ_CREATE, 1).parse());
+	CHECK(!Messages().msg(THERMAL_GENL_EVENT_TZ_TRIP_UP).attr(THERMAL_GENL_ATTR_TZ_TRIP_ID, 1).parse());
+}
+
+
+TEST(multiple_messages)
+{
+	CHECK(Messages()
+		.trip(THERMAL_GENL_EVENT_TZ_TRIP_UP, 2)
+		.trip(THERMAL_GENL_EVENT_TZ_CREATE, 1)
+		.trip(THERMAL_GENL_EVENT_TZ_TRIP_DOWN, 3)
+		.parse()
+	);
+	CHECK(!Messages()
+		.trip(THERMAL_GENL_EVENT_TZ_TRIP_UP, 2)
+		.trip(THERMAL_GENL_EVENT_TZ_TRIP_DOWN, 4)
+		.parse()
+	);
+}
+
+
+TEST(truncated)
+{
+	// Every proper prefix of a single event is rejected, down to an incomplete nlmsghdr
+	Messages m;
+	m.trip(THERMAL_GENL_EVENT_TZ_TRIP_UP, 1);
+	for (size_t len = 0; len < m.size(); ++len)
+		CHECK(!m.parse(len));
+
+	// A truncated last message doesn't hide the complete ones before it
+	Messages m2;
+	m2.trip(THERMAL_GENL_EVENT_TZ_TRIP_UP, 3);
+	const size_t first = m2.size();
+	m2.trip(THERMAL_GENL_EVENT_TZ_TRIP_UP, 4);
+	for (size_t len = first; len < m2.size(); ++len)
+		CHECK(m2.parse(len));
+}
+
+
+TEST(malformed)
+{
+	// nlmsg_len shorter than the netlink header stops parsing
+	CHECK(!Messages().trip(THERMAL_GENL_EVENT_TZ_TRIP_UP, 1).nlmsg_len(NLMSG_HDRLEN - 1).parse());
+
+	// A message that's too short for the genetlink header is skipped
+	CHECK(Messages()
+		.bare()
+		.trip(THERMAL_GENL_EVENT_TZ_TRIP_UP, 3)
+		.parse()
+	);
+
+	// nlmsg_len beyond the end of the buffer
+	CHECK(!Messages().trip(THERMAL_GENL_EVENT_TZ_TRIP_UP, 1).nlmsg_len(4096).parse());
+
+	// nlmsg_len that cuts off the zone attribute
+	CHECK(!Messages().trip(THERMAL_GENL_EVENT_TZ_TRIP_UP, 1).nlmsg_len(NLMSG_LENGTH(GENL_HDRLEN) + NLA_HDRLEN).parse());
+
+	// Attribute lengths that are too short or point beyond the message
+	CHECK(!Messages().msg(THERMAL_GENL_EVENT_TZ_TRIP_UP).attr(THERMAL_GENL_ATTR_TZ_ID, 1, NLA_HDRLEN - 1).parse());
+	CHECK(!Messages().msg(THERMAL_GENL_EVENT_TZ_TRIP_UP).attr(THERMAL_GENL_ATTR_TZ_ID, 1, 1024).parse());
+	CHECK(!Messages()
+		.msg(THERMAL_GENL_EVENT_TZ_TRIP_UP)
+		.attr(THERMAL_GENL_ATTR_TZ_TRIP_ID, 0, 0)
+		.attr(THERMAL_GENL_ATTR_TZ_ID, 1)
+		.parse()
+	);
+
+	// An empty zone ID is zone 0, which isn't watched
+	CHECK(!Messages().msg(THERMAL_GENL_EVENT_TZ_TRIP_UP).attr(THERMAL_GENL_ATTR_TZ_ID, 1, NLA_HDRLEN).parse());
+}
+
+#else
+
+TEST(no_thermal_netlink)
+{
+	// Without the kernel headers, no events are ever reported
+	const char buf[64] = { 0 };
+	CHECK(!ThermalNetlink::parse_events(buf, sizeof(buf), 0, { 0 }));
+}
+
+#endif // THERMAL_GENL_FAMILY_NAME
@@ -0,0 +1,95 @@
+/********************************************************************
+ * test_tpacpi.cpp: Parsing of /proc/acpi/ibm/thermal by the TpSensorDriver
+ * (C) 2022, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+
+#include "test.h"
+#include "sensors.h"
+#include "temperature_state.h"
+
+using namespace thinkfan;
+using test::TempDir;
+
+static const char thermal[] = "temperatures:\t45 40 -128 38 0 -128 51 -128\n";
+
+
+TEST(all_temperatures)
+{
+	TempDir dir;
+	TpSensorDriver drv(dir.write("thermal", thermal), false);
+	drv.try_init();
+	CHECK(drv.initialized());
+	CHECK_EQ(drv.num_temps(), 8u);
+
+	TemperatureState ts(drv.num_temps());
+	drv.init_temp_state_ref(ts.ref(drv.num_temps()));
+	drv.read_temps();
+	const vector<int> expected { 45, 40, -128, 38, 0, -128, 51, -128 };
+	CHECK(ts.temps() == ArrayView<int>(expected.data(), expected.size()));
+}
+
+
+TEST(selected_temperatures)
+{
+	TempDir dir;
+	// Indices are stored in file order, regardless of the order in the config
+	TpSensorDriver drv(dir.write("thermal", thermal), false, vector<unsigned int> { 6, 0, 3 }, vector<int> { 1, 2, 3 });
+	drv.try_init();
+	CHECK_EQ(drv.num_temps(), 3u);
+
+	TemperatureState ts(drv.num_temps());
+	drv.init_temp_state_ref(ts.ref(drv.num_temps()));
+	drv.read_temps();
+	CHECK_EQ(ts.temps()[0], 46);
+	CHECK_EQ(ts.temps()[1], 40);
+	CHECK_EQ(ts.temps()[2], 54);
+}
+
+
+TEST(bad_index)
+{
+	TempDir dir;
+	TpSensorDriver drv(dir.write("thermal", thermal), false, vector<unsigned int> { 8 });
+	CHECK_THROWS(ConfigError, drv.try_init());
+}
+
+
+// Driver::robust_op() rethrows errors it doesn't tolerate as ExpectedError
+TEST(unknown_format)
+{
+	TempDir dir;
+	TpSensorDriver drv(dir.write("thermal", "tempratures: 45 40\n"), false);
+	CHECK_THROWS(ExpectedError, drv.try_init());
+	CHECK(!drv.initialized());
+}
+
+
+TEST(truncated_read)
+{
+	TempDir dir;
+	const string path = dir.write("thermal", thermal);
+	TpSensorDriver drv(path, false, vector<unsigned int> { 0, 6 });
+	drv.try_init();
+
+	TemperatureState ts(drv.num_temps());
+	drv.init_temp_state_ref(ts.ref(drv.num_temps()));
+	dir.write("thermal", "temperatures:\t45 40 -128\n");
+	CHECK_THROWS(ExpectedError, drv.read_temps());
+}